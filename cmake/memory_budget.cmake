@@ -0,0 +1,42 @@
+# Report the RAM and flash used by the firmware and fail when a budget is exceeded.
+# Run as a post-build step:
+#   cmake -DSIZE_TOOL=<arm-none-eabi-size> -DELF=<firmware.elf>
+#         -DRAM_BUDGET=<bytes> -DFLASH_BUDGET=<bytes> -P memory_budget.cmake
+#
+# Flash holds text (code, read-only data) plus the initial values of data.
+# RAM holds data and bss, which includes the stacks reserved by the linker script.
+
+execute_process(
+    COMMAND ${SIZE_TOOL} -B ${ELF}
+    OUTPUT_VARIABLE size_output
+    RESULT_VARIABLE size_result
+)
+if(NOT size_result EQUAL 0)
+    message(FATAL_ERROR "Memory budget: could not run ${SIZE_TOOL} on ${ELF}")
+endif()
+
+# Second line: text data bss dec hex filename
+string(REGEX MATCH "\n[ \t]*([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)" _ "${size_output}")
+set(text ${CMAKE_MATCH_1})
+set(data ${CMAKE_MATCH_2})
+set(bss ${CMAKE_MATCH_3})
+if(NOT DEFINED text OR text STREQUAL "")
+    message(FATAL_ERROR "Memory budget: unexpected output from ${SIZE_TOOL}:\n${size_output}")
+endif()
+
+math(EXPR flash_used "${text} + ${data}")
+math(EXPR ram_used "${data} + ${bss}")
+math(EXPR flash_percent "${flash_used} * 100 / ${FLASH_BUDGET}")
+math(EXPR ram_percent "${ram_used} * 100 / ${RAM_BUDGET}")
+
+message("Memory budget: flash ${flash_used} of ${FLASH_BUDGET} bytes (${flash_percent}%)")
+message("Memory budget: RAM ${ram_used} of ${RAM_BUDGET} bytes (${ram_percent}%)")
+
+if(flash_used GREATER FLASH_BUDGET)
+    math(EXPR over "${flash_used} - ${FLASH_BUDGET}")
+    message(FATAL_ERROR "Memory budget: flash exceeded by ${over} bytes")
+endif()
+if(ram_used GREATER RAM_BUDGET)
+    math(EXPR over "${ram_used} - ${RAM_BUDGET}")
+    message(FATAL_ERROR "Memory budget: RAM exceeded by ${over} bytes")
+endif()
@@ -36,6 +36,32 @@
 #define MOTOR_PIN_DESCRIPTION   "PWM vibration"
 /** @} */
 
+/**
+ * @defgroup MotorDrive Motor Drive Constants
+ * @{
+ */
+// Drive levels are in tenths of a percent of duty cycle, so the PWM wraps at 999.
+// Each table row holds the kick levels, applied for the table's kick time to spin the motor up,
+// then the sustain levels, for battery voltages from MOTOR_DRIVE_MIN_MV upwards in
+// MOTOR_DRIVE_STEP_MV steps. Sustain keeps the effective motor voltage constant
+// (3.0V on accents, 1.2V otherwise); the kick brings the motor to that speed by the
+// end of the kick time, at every battery voltage, so onset latency stays constant too.
+// Accents are capped at 3.0V since the motor feels no stronger beyond that. An empty
+// battery can only just reach it, which sets the accent kick time at 70ms.
+// Values come from a first-order motor model with a 25ms time constant,
+// see tools/motor_model.c.
+#define MOTOR_PWM_WRAP          999
+#define MOTOR_KICK_ACCENT_MS    70
+#define MOTOR_KICK_NORMAL_MS    15
+#define MOTOR_DRIVE_MIN_MV      3200
+#define MOTOR_DRIVE_STEP_MV     100
+#define MOTOR_DRIVE_STEPS       11
+#define MOTOR_DRIVE_ACCENT      {{ 998,  968,  939,  913,  887,  863,  841,  819,  799,  779,  761}, \
+                                 { 938,  909,  882,  857,  833,  811,  789,  769,  750,  732,  714}}
+#define MOTOR_DRIVE_NORMAL      {{ 831,  806,  782,  760,  739,  719,  700,  682,  665,  649,  633}, \
+                                 { 375,  364,  353,  343,  333,  324,  316,  308,  300,  293,  286}}
+/** @} */
+
 /**
  * @defgroup VibrationSwitch Vibration Switch Pin Definitions
  * @{
@@ -52,6 +78,18 @@
 #define LOW_BATT_LED_DESCRIPTION    "Low battery LED"
 /** @} */
 
+/**
+ * @defgroup BatteryCheck Battery Check Constants
+ * @{
+ */
+// The Pico measures VSYS through a 1:3 divider on GPIO29 (ADC input 3).
+#define BATTERY_ADC_PIN         29
+#define BATTERY_ADC_INPUT       3
+#define BATTERY_ADC_DIVIDER     3
+#define BATTERY_CHECK_MS        5000
+#define BATTERY_LOW_MV          3400    // Turn on the low battery LED below this
+/** @} */
+
 /**
  * @defgroup InputTimeout Input Timeout Constants
  * @{
@@ -68,11 +106,69 @@
 #define NOTIF_DURATION_MS       500
 /** @} */
 
+/**
+ * @defgroup PhaseIndicator Phase Indicator Constants
+ * @{
+ */
+// Set to 1 to have the LEDs fade in towards the next beat instead of staying dark.
+// The fade is streamed to the LED PWM by DMA, paced by an otherwise unused PWM slice.
+// A pacer step is at most 255 x 65536 cycles, about 134ms at 125MHz, so the fade
+// can last up to about 8.5s. Below about 7 BPM it ends early.
+#define PHASE_INDICATOR         0
+#define PHASE_STEPS             64
+#define PHASE_MAX_LEVEL         48      // Brightness at the end of the fade, out of 255
+#define PHASE_PACER_SLICE       7
+/** @} */
+
+/**
+ * @defgroup EdgeCapture Edge Capture Constants
+ * @{
+ */
+// Set to 1 to time the LED and motor outputs with PIO and compare them against the
+// scheduled ticks. The error histograms are printed with the USB stats command.
+// With the phase indicator on, only the motor is measured.
+#define EDGE_CAPTURE            0
+#define EDGE_RING_WORDS         64      // Captured events buffered per pin, power of two
+#define EDGE_CHECK_MS           100
+/** @} */
+
 /**
  * @defgroup InactiveTimeout Inactive Timeout Constants
  * @{
  */
 #define INACTIVE_TIMEOUT        10*60*1000*1000 // Ten minutes, in us
+#define INACTIVE_CHECK_MS       5000
+/** @} */
+
+/**
+ * @defgroup TempoRepeat Hold-to-Repeat Constants
+ * @{
+ */
+// Holding + or - speeds up the longer the key is held. Each stage applies from its
+// hold time onwards: {hold time in ms, repeat period in ms, step in BPM}.
+// Steps larger than 1 snap the tempo to multiples of the step.
+#define TEMPO_REPEAT_STAGES         {{0, 150, 1}, {1000, 80, 1}, {2000, 80, 5}, {3500, 80, 10}}
+#define TEMPO_REPEAT_STAGE_COUNT    4
+/** @} */
+
+/**
+ * @defgroup BackgroundJobs Background Job Constants
+ * @{
+ */
+// Deferrable work only runs in the idle window between a settled beat and the next tick.
+// Each job declares its worst-case duration, in us, so it never runs into the next deadline.
+// When beats are too close for the outputs to ever settle, a job stops waiting for them
+// after BG_SETTLE_MAX_WAIT_MS, but still has to fit before the next tick.
+#define BG_SLACK_GUARD_US       2000    // Margin kept free before the next tick
+#define BG_SETTLE_MAX_WAIT_MS   1000
+#define BG_WCET_INACTIVE_US     100
+#define BG_WCET_BATTERY_US      100     // One ADC conversion
+#define BG_WCET_STATS_US        5000    // Printing the counters over USB
+#define BG_WCET_TEMPO_REPEAT_US 50
+#define BG_WCET_LOG_PROGRAM_US  3000    // Page program, worst case
+#define BG_WCET_LOG_ERASE_US    400000  // Sector erase, worst case
+#define BG_WCET_LOG_EXPORT_US   5000    // One page, hex-encoded, over USB
+#define BG_WCET_EDGE_CHECK_US   500
 /** @} */
 
 /**
@@ -97,9 +193,20 @@
  * @{
  */
 // Reserve the last 4KB of the default 2MB flash for persistence.
+// The settings layout is defined in settings.h.
 #define FLASH_TARGET_OFFSET (FLASH_SECTOR_SIZE*511)
-#define MAGIC_NUMBER {0x42, 0x50, 0x4D} // 'BPM' - used as a magic number
-#define MAGIC_NUMBER_LENGTH 3
+/** @} */
+
+/**
+ * @defgroup SessionLog Session Log Constants
+ * @{
+ */
+// The practice-session log uses the 256KB right below the presets, as a ring of sectors
+#define LOG_FLASH_SECTORS       64
+#define LOG_FLASH_OFFSET        (FLASH_TARGET_OFFSET - FLASH_SECTOR_SIZE*LOG_FLASH_SECTORS)
+#define LOG_FLUSH_MS            30000   // Records are batched in RAM for up to this long
+#define LOG_ERASE_RETRY_MS      1000    // How often a pending sector erase checks for the session to end
+#define LOG_SESSION_GAP_MS      10000   // A session ends after the metronome is stopped this long
 /** @} */
 
 /**
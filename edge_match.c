@@ -0,0 +1,97 @@
+/**
+ * @file edge_match.c
+ * @brief Matching of captured output edges against the times they were scheduled for.
+ * @author Turi Scandurra
+ */
+
+#include <string.h>
+#include "edge_match.h"
+
+/**
+ * @brief Reset all queues and histograms.
+ * @param m Matcher.
+ */
+void edge_match_init(edge_matcher_t *m){
+    memset(m, 0, sizeof(*m));
+}
+
+/**
+ * @brief Drop the oldest expectation of a channel.
+ */
+static void pop(edge_channel_t *ch){
+    ch->head = (ch->head + 1) % EDGE_QUEUE_LEN;
+    ch->count--;
+}
+
+/**
+ * @brief Add an error to a histogram.
+ * @param hist Histogram.
+ * @param error_us Actual minus intended time.
+ */
+static void record(edge_hist_t *hist, int32_t error_us){
+    uint32_t magnitude = (error_us < 0) ? -error_us : error_us;
+    uint8_t bucket = 0;
+    while(bucket < EDGE_HIST_BUCKETS - 1 && (magnitude >> (bucket + 1))) { bucket++; }
+    hist->buckets[bucket]++;
+    hist->matched++;
+    hist->error_sum_us += error_us;
+    int32_t worst = (hist->worst_us < 0) ? -hist->worst_us : hist->worst_us;
+    if(magnitude > (uint32_t)worst) { hist->worst_us = error_us; }
+}
+
+/**
+ * @brief Queue an expected edge. Expectations must be queued in time order.
+ * @param m Matcher.
+ * @param channel Output channel.
+ * @param time_us When the edge is scheduled.
+ * @param level true for the start of activity, false for the end.
+ * @return false if the queue is full.
+ */
+bool edge_match_expect(edge_matcher_t *m, uint8_t channel, uint32_t time_us, bool level){
+    edge_channel_t *ch = &m->channels[channel];
+    if(ch->count == EDGE_QUEUE_LEN) { return false; }
+    ch->queue[(ch->head + ch->count) % EDGE_QUEUE_LEN] = (edge_expect_t){ time_us, level };
+    ch->count++;
+    return true;
+}
+
+/**
+ * @brief Match a captured edge. Edges must be fed in time order.
+ * @param m Matcher.
+ * @param channel Output channel.
+ * @param time_us When the edge happened.
+ * @param level true for the start of activity, false for the end.
+ */
+void edge_match_edge(edge_matcher_t *m, uint8_t channel, uint32_t time_us, bool level){
+    edge_channel_t *ch = &m->channels[channel];
+    // Anything due well before this edge is never going to be matched
+    while(ch->count && (int32_t)(time_us - ch->queue[ch->head].time_us) > EDGE_MATCH_WINDOW_US){
+        ch->hist.missed++;
+        pop(ch);
+    }
+    if(ch->count){
+        edge_expect_t *e = &ch->queue[ch->head];
+        int32_t error_us = (int32_t)(time_us - e->time_us);
+        if(e->level == level && error_us >= -EDGE_MATCH_WINDOW_US){
+            record(&ch->hist, error_us);
+            pop(ch);
+            return;
+        }
+    }
+    ch->hist.unexpected++;
+}
+
+/**
+ * @brief Count the expectations that can no longer be matched as missed.
+ * @param m Matcher.
+ * @param now_us Time up to which all edges have been fed.
+ */
+void edge_match_expire(edge_matcher_t *m, uint32_t now_us){
+    for(uint8_t c=0; c<EDGE_CHANNELS; c++){
+        edge_channel_t *ch = &m->channels[c];
+        while(ch->count && (int32_t)(now_us - ch->queue[ch->head].time_us) > EDGE_MATCH_WINDOW_US){
+            ch->hist.missed++;
+            pop(ch);
+        }
+    }
+}
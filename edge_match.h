@@ -0,0 +1,53 @@
+/**
+ * @file edge_match.h
+ * @brief Matching of captured output edges against the times they were scheduled for.
+ *
+ * Each channel keeps a queue of expected edges. Every captured edge is paired with
+ * the oldest expectation of the same level within EDGE_MATCH_WINDOW_US, and the
+ * timing error goes into a histogram. Expectations that pass without an edge count
+ * as missed, edges without an expectation count as unexpected.
+ * Times are 32-bit microseconds and may wrap.
+ */
+
+#ifndef EDGE_MATCH_H_
+#define EDGE_MATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EDGE_CHANNELS           4
+#define EDGE_QUEUE_LEN          8       // Expected edges per channel
+#define EDGE_HIST_BUCKETS       10      // Bucket 0 is under 2us, bucket n is 2^n to 2^(n+1) us, the last one is open-ended
+#define EDGE_MATCH_WINDOW_US    5000
+
+typedef struct {
+    uint32_t time_us;
+    bool level;                 // true for the start of activity
+} edge_expect_t;
+
+typedef struct {
+    uint32_t buckets[EDGE_HIST_BUCKETS];    // Absolute timing error
+    uint32_t matched;
+    int64_t error_sum_us;
+    int32_t worst_us;           // Largest error, with its sign
+    uint32_t missed;
+    uint32_t unexpected;
+} edge_hist_t;
+
+typedef struct {
+    edge_expect_t queue[EDGE_QUEUE_LEN];
+    uint8_t head;
+    uint8_t count;
+    edge_hist_t hist;
+} edge_channel_t;
+
+typedef struct {
+    edge_channel_t channels[EDGE_CHANNELS];
+} edge_matcher_t;
+
+void edge_match_init(edge_matcher_t *m);
+bool edge_match_expect(edge_matcher_t *m, uint8_t channel, uint32_t time_us, bool level);
+void edge_match_edge(edge_matcher_t *m, uint8_t channel, uint32_t time_us, bool level);
+void edge_match_expire(edge_matcher_t *m, uint32_t now_us);
+
+#endif /* EDGE_MATCH_H_ */
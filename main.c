@@ -6,6 +6,8 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <malloc.h>
 #include <pico/stdlib.h>
 #include "pico/binary_info.h"
 #include "hardware/pwm.h"
@@ -13,9 +15,16 @@
 #include "hardware/sync.h"
 #include "hardware/xosc.h"
 #include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
 #include "config.h"
+#include "session_log.h"
+#include "motor_drive.h"
+#include "settings.h"
+#include "edge_match.h"
+#include "edge_capture.pio.h"
 #include "keypad.h"             // https://github.com/TuriSc/RP2040-Keypad-Matrix
-#include "battery-check.h"      // https://github.com/TuriSc/RP2040-Battery-Check
 
 /**
  * @defgroup GlobalVariables Global Variables
@@ -28,10 +37,19 @@ uint16_t tempo_prompt;
 uint8_t num_taps;
 uint8_t ticks;
 bool paused = true;
-bool recalc_interval;
+bool recalc_interval;          // Apply a new tempo from the next tick, without restarting
+int8_t tempo_repeat_dir;        // 1 while + is held, -1 while - is held
+uint64_t tempo_repeat_start;    // When the hold started, in us since boot
 uint64_t last_press;            // Used to determine when to enter energy-saving mode
+uint64_t tick_interval;         // Current interval between ticks, in us
+uint64_t stopped_time;          // When the metronome last stopped, in us since boot
+volatile uint64_t last_tick_time;   // When the latest tick fired, in us since boot
+volatile uint64_t next_tick_time;   // When the next tick is scheduled, in us since boot
 
 uint8_t motor_pin_slice;
+uint16_t battery_mv;            // Filtered battery voltage
+uint16_t motor_sustain_level;   // Drive level to apply once the kick is over
+uint32_t motor_sustain_us;
 
 static alarm_id_t power_on_alarm;
 static alarm_id_t blink_alarm;
@@ -39,38 +57,101 @@ static alarm_id_t vibrate_alarm;
 static alarm_id_t type_timeout_alarm;
 static alarm_id_t tap_timeout_alarm;
 static repeating_timer_t metronome;
-static repeating_timer_t tempo_change;
-static repeating_timer_t inactive_alarm;
 
 KeypadMatrix keypad;
 const uint8_t cols[] = KEYPAD_COLS;
 const uint8_t rows[] = KEYPAD_ROWS;
 bool long_pressed_release_lock; // Used to prevent triggering a release event after a long press
 
-uint8_t preset_buffer[FLASH_PAGE_SIZE];
+static uint8_t flash_buffer[FLASH_PAGE_SIZE]; // Kept off the stack, which beat callbacks share
 uint8_t tempo_presets[4] = DEFAULT_TEMPO_PRESETS;
 uint8_t subdiv_presets[4] = DEFAULT_SUBDIV_PRESETS;
 uint8_t accent_presets[4] = DEFAULT_ACCENT_PRESETS;
+
+const uint16_t motor_drive_accent[2][MOTOR_DRIVE_STEPS] = MOTOR_DRIVE_ACCENT;
+const uint16_t motor_drive_normal[2][MOTOR_DRIVE_STEPS] = MOTOR_DRIVE_NORMAL;
+static_assert(VIBRATION_DURATION_MS > MOTOR_KICK_ACCENT_MS && VIBRATION_DURATION_MS > MOTOR_KICK_NORMAL_MS,
+              "Vibrations must outlast the motor kick");
+const uint16_t tempo_repeat_stages[TEMPO_REPEAT_STAGE_COUNT][3] = TEMPO_REPEAT_STAGES;
 /** @} */
 
 bool tick();
 int64_t blink_complete();
 int64_t vibrate_complete();
+void bg_job_post(uint8_t job, uint32_t delay_ms);
+void bg_job_cancel(uint8_t job);
+void bg_run();
+void battery_check();
+void tempo_repeat();
+void log_program();
+void log_erase();
+void log_export();
+void log_session_end();
+void log_taps();
+void log_export_start();
+#if EDGE_CAPTURE
+void edge_check();
+void edge_print_stats();
+#endif
+
+// Background jobs, in order of priority
+enum {
+    BG_JOB_TEMPO_REPEAT,
+    BG_JOB_INACTIVE_CHECK,
+    BG_JOB_BATTERY_CHECK,
+    BG_JOB_LOG_ERASE,
+    BG_JOB_LOG_PROGRAM,
+    BG_JOB_STATS,
+    BG_JOB_LOG_EXPORT,
+#if EDGE_CAPTURE
+    BG_JOB_EDGE_CHECK,
+#endif
+    BG_JOB_COUNT
+};
 
 /**
  * @defgroup FlashFunctions Flash Functions
  * @{
  */
+/**
+ * @brief CRC-32 computed by the DMA sniffer while the data is copied to a dummy sink.
+ * @param data Data to checksum.
+ * @param len Length of the data.
+ * @return CRC-32 of the data, matching settings_crc32().
+ */
+uint32_t sniff_crc32(const uint8_t *data, uint16_t len){
+    static uint8_t sink;
+    uint8_t ch = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_sniff_enable(&c, true);
+    // Bit-reversed data plus reversed, inverted output gives the zlib CRC-32
+    dma_sniffer_enable(ch, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+    dma_sniffer_set_output_reverse_enabled(true);
+    dma_sniffer_set_output_invert_enabled(true);
+    dma_sniffer_set_data_accumulator(0xFFFFFFFF);
+    dma_channel_configure(ch, &c, &sink, data, len, true);
+    dma_channel_wait_for_finish_blocking(ch);
+    uint32_t crc = dma_sniffer_get_data_accumulator();
+    dma_sniffer_disable();
+    dma_channel_unclaim(ch);
+    return crc;
+}
+
 /**
  * @brief Write the tempo presets to flash memory.
  */
 void write_flash_presets() {
-    uint8_t flash_buffer[FLASH_PAGE_SIZE] = MAGIC_NUMBER; // Initialize the buffer with a signature
-    for(uint8_t i=0; i<4; i++){
-        flash_buffer[MAGIC_NUMBER_LENGTH + i] = tempo_presets[i];
-        flash_buffer[MAGIC_NUMBER_LENGTH + i + 4] = subdiv_presets[i];
-        flash_buffer[MAGIC_NUMBER_LENGTH + i + 8] = accent_presets[i];
+    settings_t s;
+    for(uint8_t i=0; i<SETTINGS_PRESETS; i++){
+        s.tempo[i] = tempo_presets[i];
+        s.subdiv[i] = subdiv_presets[i];
+        s.accent[i] = accent_presets[i];
     }
+    memset(flash_buffer, 0xFF, FLASH_PAGE_SIZE);
+    settings_encode(&s, flash_buffer, sniff_crc32);
     uint32_t ints_id = save_and_disable_interrupts();
 	flash_range_erase(FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE); // Required for flash_range_program to work
 	flash_range_program(FLASH_TARGET_OFFSET, flash_buffer, FLASH_PAGE_SIZE);
@@ -79,58 +160,154 @@ void write_flash_presets() {
 
 /**
  * @brief Read the tempo presets from flash memory.
+ * Settings stored by any earlier firmware version are migrated.
  */
 void read_flash_presets(){ // Only called at startup
     // Read address is different than write address
     const uint8_t *stored_presets = (const uint8_t *) (XIP_BASE + FLASH_TARGET_OFFSET);
-
-    // Validation
-    uint8_t magic[3] = MAGIC_NUMBER;
-    bool invalid_data = false;
-    for(uint8_t i=0; i<MAGIC_NUMBER_LENGTH; i++){
-        if(stored_presets[i] != magic[i]){ invalid_data = true; }
-    }
-    for(uint8_t i=0; i<4; i++){
-        // Validate tempi
-        if(stored_presets[MAGIC_NUMBER_LENGTH + i] < 1
-        || stored_presets[MAGIC_NUMBER_LENGTH + i] > 255 ){ invalid_data = true; }
-        // Validate subdivisions
-        if(stored_presets[MAGIC_NUMBER_LENGTH + i + 4] < 1
-        || stored_presets[MAGIC_NUMBER_LENGTH + i + 4] > 10 ){ invalid_data = true; }
-        // Validate accents
-        if(stored_presets[MAGIC_NUMBER_LENGTH + i + 8] > 1 ){ invalid_data = true; }
-    }
-    if(!invalid_data){
+    settings_t s;
+    if(settings_decode(stored_presets, FLASH_PAGE_SIZE, &s, sniff_crc32)){
         // Presets are valid and can be loaded safely
-        for(uint8_t i=0; i<4; i++){
-            tempo_presets[i] = stored_presets[MAGIC_NUMBER_LENGTH + i];
-            subdiv_presets[i] = stored_presets[MAGIC_NUMBER_LENGTH + i + 4];
-            accent_presets[i] = stored_presets[MAGIC_NUMBER_LENGTH + i + 8];
+        for(uint8_t i=0; i<SETTINGS_PRESETS; i++){
+            tempo_presets[i] = s.tempo[i];
+            subdiv_presets[i] = s.subdiv[i];
+            accent_presets[i] = s.accent[i];
         }
     }
 }
 /** @} */
 
+/**
+ * @defgroup MemoryUsage Memory Usage
+ * @{
+ */
+// Interrupt handlers run on the core0 stack, so its high-water mark covers both.
+// The deepest stack pointer seen on entry to our own alarm callbacks shows how
+// much of it the main loop had already used when an interrupt came in.
+#define STACK_PAINT 0xC5C5C5C5
+#define STACK_PAINT_MARGIN 64   // Bytes left unpainted below the painter's own frame
+
+// Provided by the SDK linker script
+extern uint32_t __StackBottom, __StackTop;          // core0, SCRATCH_Y
+extern uint32_t __StackOneBottom, __StackOneTop;    // core1, SCRATCH_X
+extern char __end__, __StackLimit;                  // Heap start and limit
+
+static volatile uintptr_t irq_sp_min = UINTPTR_MAX;
+
+static inline uintptr_t stack_pointer(){
+    uintptr_t sp;
+    __asm volatile ("mov %0, sp" : "=r" (sp));
+    return sp;
+}
+
+/**
+ * @brief Record the stack depth at the start of an interrupt callback.
+ */
+static inline void stack_sample_irq(){
+    uintptr_t sp = stack_pointer();
+    if(sp < irq_sp_min) { irq_sp_min = sp; }
+}
+
+/**
+ * @brief Fill the unused part of both stacks with a known pattern.
+ * Called first thing in main(), before the stacks see any real use.
+ */
+void __attribute__((noinline)) stack_paint(){
+    uint32_t *limit = (uint32_t *)(stack_pointer() - STACK_PAINT_MARGIN);
+    for(uint32_t *p = &__StackBottom; p < limit; p++) { *p = STACK_PAINT; }
+    for(uint32_t *p = &__StackOneBottom; p < &__StackOneTop; p++) { *p = STACK_PAINT; }
+}
+
+/**
+ * @brief Stack high-water mark: bytes that no longer hold the paint pattern.
+ * @param bottom Lowest word of the stack.
+ * @param top One past the highest word of the stack.
+ * @return Bytes used at the deepest point so far.
+ */
+uint32_t stack_used(const uint32_t *bottom, const uint32_t *top){
+    const uint32_t *p = bottom;
+    while(p < top && *p == STACK_PAINT) { p++; }
+    return (top - p) * sizeof(uint32_t);
+}
+
+/**
+ * @brief Print the stack and RAM high-water marks.
+ */
+void memory_print_stats(){
+    uint32_t size0 = (&__StackTop - &__StackBottom) * sizeof(uint32_t);
+    uint32_t size1 = (&__StackOneTop - &__StackOneBottom) * sizeof(uint32_t);
+    uint32_t used0 = stack_used(&__StackBottom, &__StackTop);
+    printf("stack core0 %lu/%lu%s\n", (unsigned long)used0, (unsigned long)size0,
+           used0 == size0 ? ", overflowed" : "");
+    printf("stack core1 %lu/%lu\n", (unsigned long)stack_used(&__StackOneBottom, &__StackOneTop),
+           (unsigned long)size1);
+    uintptr_t irq_sp = irq_sp_min;
+    if(irq_sp != UINTPTR_MAX){
+        printf("stack irq entry %lu\n", (unsigned long)((uintptr_t)&__StackTop - irq_sp));
+    }
+    // The heap only grows, so its current size is also its high-water mark
+    printf("ram static %lu, heap %lu/%lu\n", (unsigned long)(&__end__ - (char *)SRAM_BASE),
+           (unsigned long)mallinfo().arena, (unsigned long)(&__StackLimit - &__end__));
+}
+/** @} */
+
 /**
  * @defgroup SupportingFunctions Supporting Functions
  * @{
  */
 
-bool inactive_check(){
+/**
+ * @brief Background job: enter dormant mode after a long inactivity.
+ */
+void inactive_check(){
     if(paused && (time_us_64() - last_press > INACTIVE_TIMEOUT)){
         // Enter dormant mode to save energy
         xosc_dormant();
     }
-    return true;
+    if(paused && (time_us_64() - stopped_time > (uint64_t)LOG_SESSION_GAP_MS * 1000)){
+        log_session_end();
+    }
+    bg_job_post(BG_JOB_INACTIVE_CHECK, INACTIVE_CHECK_MS);
 }
 
 /**
- * @brief Battery low callback.
- * @param battery_mv Battery voltage in millivolts.
+ * @brief Read the battery voltage.
+ * @return Battery voltage in millivolts, unfiltered.
  */
-void battery_low_callback(uint16_t battery_mv){
-    gpio_put(LOW_BATT_LED_PIN, 1);
-    battery_check_stop();
+uint16_t battery_read(){
+    return (uint32_t)adc_read() * BATTERY_ADC_DIVIDER * 3300 / 4096;
+}
+
+/**
+ * @brief Turn on the low battery LED if the battery needs recharging.
+ */
+void battery_low_check(){
+    if(battery_mv < BATTERY_LOW_MV){
+        gpio_put(LOW_BATT_LED_PIN, 1);
+    }
+}
+
+/**
+ * @brief Set up the ADC input used to measure the battery, and take the first reading.
+ * The motor is still off at this point, so the reading is used as it is.
+ */
+void battery_check_init(){
+    adc_init();
+    adc_gpio_init(BATTERY_ADC_PIN);
+    adc_select_input(BATTERY_ADC_INPUT);
+    battery_mv = battery_read();
+    battery_low_check();
+}
+
+/**
+ * @brief Background job: measure the battery voltage.
+ * Runs once the beat has settled, so the reading is not taken while the motor loads the battery.
+ */
+void battery_check(){
+    // Smooth out ADC noise and the sag caused by the motor itself
+    battery_mv = (battery_mv * 3 + battery_read()) / 4;
+    battery_low_check();
+    bg_job_post(BG_JOB_BATTERY_CHECK, BATTERY_CHECK_MS);
 }
 
 /**
@@ -171,6 +348,636 @@ uint8_t interval_to_bpm(uint64_t interval){
 }
 /** @} */
 
+/**
+ * @defgroup BackgroundJobs Background Jobs
+ * @{
+ */
+// Blink and vibration must be over before the beat is considered settled
+#define OUTPUT_SETTLE_US ((uint64_t)(BLINK_DURATION_MS > VIBRATION_DURATION_MS ? \
+                                     BLINK_DURATION_MS : VIBRATION_DURATION_MS) * 1000)
+
+typedef struct {
+    void (*run)();
+    uint32_t wcet_us;           // Declared worst-case duration
+    bool settled;               // Wait until the beat's outputs are over
+    bool pending;
+    bool deferred;              // Already counted as deferred since it was posted
+    uint64_t deferred_since;    // When it was first deferred, in us since boot
+    uint64_t due;               // Earliest start time, in us since boot
+} bg_job_t;
+
+uint32_t bg_deferred_count;     // Jobs that had to wait for lack of slack
+uint32_t log_dropped;           // Log records lost because the RAM batch was full
+
+/**
+ * @brief Background job: print the runtime counters over USB.
+ */
+void print_stats(){
+    printf("%s %s\n", PROGRAM_NAME, PROGRAM_VERSION);
+    printf("tempo %u, subdiv %u, accent %u%s\n", tempo, subdiv, accent, paused ? ", paused" : "");
+    printf("bg deferred %lu\n", (unsigned long)bg_deferred_count);
+    printf("log dropped %lu\n", (unsigned long)log_dropped);
+    memory_print_stats();
+#if EDGE_CAPTURE
+    edge_print_stats();
+#endif
+}
+
+static bg_job_t bg_jobs[BG_JOB_COUNT] = {
+    [BG_JOB_TEMPO_REPEAT]   = { tempo_repeat,        BG_WCET_TEMPO_REPEAT_US, false },
+    [BG_JOB_INACTIVE_CHECK] = { inactive_check,      BG_WCET_INACTIVE_US,     true },
+    [BG_JOB_BATTERY_CHECK]  = { battery_check,       BG_WCET_BATTERY_US,      true },
+    [BG_JOB_LOG_ERASE]      = { log_erase,           BG_WCET_LOG_ERASE_US,    true },
+    [BG_JOB_LOG_PROGRAM]    = { log_program,         BG_WCET_LOG_PROGRAM_US,  true },
+    [BG_JOB_STATS]          = { print_stats,         BG_WCET_STATS_US,        true },
+    [BG_JOB_LOG_EXPORT]     = { log_export,          BG_WCET_LOG_EXPORT_US,   true },
+#if EDGE_CAPTURE
+    [BG_JOB_EDGE_CHECK]     = { edge_check,          BG_WCET_EDGE_CHECK_US,   false },
+#endif
+};
+
+/**
+ * @brief Queue a background job.
+ * @param job Job identifier.
+ * @param delay_ms Minimum delay before the job may run.
+ */
+void bg_job_post(uint8_t job, uint32_t delay_ms){
+    bg_jobs[job].due = time_us_64() + (uint64_t)delay_ms * 1000;
+    bg_jobs[job].pending = true;
+}
+
+/**
+ * @brief Drop a queued background job.
+ * @param job Job identifier.
+ */
+void bg_job_cancel(uint8_t job){
+    bg_jobs[job].pending = false;
+    bg_jobs[job].deferred = false;
+}
+
+/**
+ * @brief Check whether a job fits in the current idle window.
+ * @param wcet_us Declared worst-case duration of the job.
+ * @param settled Whether the job must wait for the beat's outputs to be over.
+ * @return true if the job can run now without reaching the next tick.
+ */
+bool bg_slack_available(uint32_t wcet_us, bool settled){
+    if(paused) { return true; }
+    // The tick runs in interrupt context, so take a consistent copy of its timing
+    uint32_t ints_id = save_and_disable_interrupts();
+    uint64_t beat = last_tick_time;
+    uint64_t deadline = next_tick_time; // Also right after a (re)start, before the first tick
+    restore_interrupts(ints_id);
+
+    uint64_t now = time_us_64();
+    if(settled && now < beat + OUTPUT_SETTLE_US) { return false; } // LEDs and motor still active
+    return now + wcet_us + BG_SLACK_GUARD_US <= deadline;
+}
+
+/**
+ * @brief Run the pending background jobs that fit before the next tick.
+ * Called from the main loop, never from interrupt context.
+ */
+void bg_run(){
+    for(uint8_t i=0; i<BG_JOB_COUNT; i++){
+        bg_job_t *job = &bg_jobs[i];
+        if(!job->pending || time_us_64() < job->due) { continue; }
+        // Don't let a job wait forever for outputs that never settle at fast tempos
+        bool settled = job->settled && !(job->deferred &&
+            time_us_64() - job->deferred_since > (uint64_t)BG_SETTLE_MAX_WAIT_MS * 1000);
+        if(!bg_slack_available(job->wcet_us, settled)){
+            if(!job->deferred) {
+                job->deferred = true;
+                job->deferred_since = time_us_64();
+                bg_deferred_count++;
+            }
+            continue;
+        }
+        job->pending = false;
+        job->deferred = false;
+        job->run();
+    }
+}
+
+/**
+ * @brief Handle single-character commands received over USB serial.
+ */
+void usb_command_poll(){
+    switch(getchar_timeout_us(0)){
+        case 's':
+            bg_job_post(BG_JOB_STATS, 0);
+            break;
+        case 'l':
+            log_export_start();
+            break;
+    }
+}
+/** @} */
+
+/**
+ * @defgroup SessionLog Session Log
+ * @{
+ */
+#define LOG_PAGES_PER_SECTOR    (FLASH_SECTOR_SIZE / LOG_PAGE_SIZE)
+#define LOG_PAGES               (LOG_FLASH_SECTORS * LOG_PAGES_PER_SECTOR)
+static_assert(LOG_PAGE_SIZE == FLASH_PAGE_SIZE, "Log pages must match flash pages");
+
+typedef struct {
+    log_page_t page;
+    uint16_t index;             // Flash page it belongs to, counted from LOG_FLASH_OFFSET
+    bool programmed;            // Written to flash at least once
+} log_buffer_t;
+
+static log_buffer_t log_fill;   // Page receiving new records
+static log_buffer_t log_sealed; // Full page waiting to be programmed
+static bool log_sealed_pending;
+static bool log_fill_dirty;     // log_fill has records that are not on flash yet
+static int16_t log_erased_sector = -1; // Sector known to be blank
+static uint32_t log_seq;
+static uint16_t log_boot;
+static uint16_t log_export_pos;
+
+bool log_session;               // A practice session is in progress
+uint8_t log_tempo;              // Settings as last logged
+uint8_t log_subdiv;
+bool log_accent;
+uint16_t tap_count;             // Taps measured against the running average
+uint64_t tap_error_sum;
+uint32_t tap_last_ms;           // Time of the latest measured tap
+bool tap_in_progress;           // tap() is running, so its own tempo changes don't end the sequence
+
+/**
+ * @brief Time since boot in milliseconds.
+ */
+uint32_t now_ms(){
+    return (uint32_t)(time_us_64() / 1000);
+}
+
+/**
+ * @brief Find where the log left off. Only called at startup.
+ */
+void log_init(){
+    const uint8_t *region = (const uint8_t *) (XIP_BASE + LOG_FLASH_OFFSET);
+    bool found = false;
+    uint32_t newest_seq = 0;
+    uint16_t newest = 0;
+    uint16_t newest_boot = 0;
+    for(uint16_t i=0; i<LOG_PAGES; i++){
+        uint32_t seq, base_ms;
+        uint16_t boot;
+        if(!log_page_header(&region[i * LOG_PAGE_SIZE], &seq, &boot, &base_ms)) { continue; }
+        if(!found || seq > newest_seq){
+            newest_seq = seq;
+            newest = i;
+            newest_boot = boot;
+            found = true;
+        }
+    }
+    log_seq = found ? newest_seq + 1 : 0;
+    log_boot = found ? newest_boot + 1 : 0;
+    log_fill.index = found ? (newest + 1) % LOG_PAGES : 0;
+    // The rest of a sector stays blank until the log gets there
+    if(log_fill.index % LOG_PAGES_PER_SECTOR) { log_erased_sector = log_fill.index / LOG_PAGES_PER_SECTOR; }
+    log_page_begin(&log_fill.page, log_seq++, log_boot, now_ms());
+}
+
+/**
+ * @brief Add a record to the RAM batch. Never touches flash.
+ * @param rec Record to add.
+ */
+void log_append(const log_record_t *rec){
+    // Anything else that happens after a tap sequence closes it, so records stay in time order
+    if(tap_count && !tap_in_progress && rec->type != LOG_REC_TAPS) { log_taps(); }
+    if(!log_page_append(&log_fill.page, rec)){
+        // The page is full: hand it over to be programmed and start a new one
+        if(log_sealed_pending) {
+            log_dropped++;
+            return;
+        }
+        log_sealed = log_fill;
+        log_sealed_pending = true;
+        log_fill.index = (log_fill.index + 1) % LOG_PAGES;
+        log_fill.programmed = false;
+        log_page_begin(&log_fill.page, log_seq++, log_boot, rec->time_ms);
+        log_page_append(&log_fill.page, rec);
+        bg_job_post(BG_JOB_LOG_PROGRAM, 0);
+    }
+    log_fill_dirty = true;
+    if(!bg_jobs[BG_JOB_LOG_PROGRAM].pending) { bg_job_post(BG_JOB_LOG_PROGRAM, LOG_FLUSH_MS); }
+}
+
+/**
+ * @brief Log the current settings, starting a session if needed.
+ * Called whenever the tempo, subdivisions or accent change.
+ */
+void log_settings(){
+    if(paused) { return; }
+    log_record_t rec = { .time_ms = now_ms(), .tempo = tempo, .subdiv = subdiv, .accent = accent };
+    if(!log_session){
+        rec.type = LOG_REC_START;
+        log_append(&rec);
+        log_session = true;
+    } else {
+        if(tempo != log_tempo){
+            rec.type = LOG_REC_TEMPO;
+            log_append(&rec);
+        }
+        if(subdiv != log_subdiv || accent != log_accent){
+            rec.type = LOG_REC_PATTERN;
+            log_append(&rec);
+        }
+    }
+    log_tempo = tempo;
+    log_subdiv = subdiv;
+    log_accent = accent;
+}
+
+/**
+ * @brief Log the accuracy of the latest tap sequence, at the time of its last tap.
+ */
+void log_taps(){
+    if(!tap_count) { return; }
+    log_record_t rec = { .type = LOG_REC_TAPS, .time_ms = tap_last_ms,
+                         .taps = tap_count, .tap_error_us = tap_error_sum / tap_count };
+    log_append(&rec);
+    tap_count = 0;
+    tap_error_sum = 0;
+}
+
+/**
+ * @brief Close the current session and flush the log at the next idle slot.
+ */
+void log_session_end(){
+    if(!log_session) { return; }
+    log_taps();
+    log_record_t rec = { .type = LOG_REC_STOP, .time_ms = stopped_time / 1000 };
+    log_append(&rec);
+    log_session = false;
+    bg_job_post(BG_JOB_LOG_PROGRAM, 0);
+}
+
+/**
+ * @brief Check whether a page can be programmed without erasing its sector first.
+ * @param buf Page to program.
+ */
+bool log_page_ready(const log_buffer_t *buf){
+    return buf->programmed
+        || buf->index % LOG_PAGES_PER_SECTOR
+        || buf->index / LOG_PAGES_PER_SECTOR == log_erased_sector;
+}
+
+/**
+ * @brief Background job: program the pending log page.
+ * A page is programmed again as it fills up, since records only turn erased bytes into data.
+ */
+void log_program(){
+    log_buffer_t *buf;
+    if(log_sealed_pending) { buf = &log_sealed; }
+    else if(log_fill_dirty) { buf = &log_fill; }
+    else { return; }
+
+    if(!log_page_ready(buf)){
+        // First page of a sector: it gets programmed once the sector is erased
+        bg_job_post(BG_JOB_LOG_ERASE, 0);
+        return;
+    }
+    uint32_t ints_id = save_and_disable_interrupts();
+    flash_range_program(LOG_FLASH_OFFSET + buf->index * LOG_PAGE_SIZE, buf->page.data, LOG_PAGE_SIZE);
+    restore_interrupts(ints_id);
+    buf->programmed = true;
+    log_page_programmed(&buf->page);
+
+    if(buf == &log_sealed){
+        log_sealed_pending = false;
+        if(log_fill_dirty) { bg_job_post(BG_JOB_LOG_PROGRAM, 0); }
+    } else {
+        log_fill_dirty = false;
+    }
+}
+
+/**
+ * @brief Background job: erase the sector the next log page goes to.
+ * Only runs once the session has ended, as interrupts stay disabled for up to 400ms:
+ * the metronome is also paused between taps and typed digits, which must not be delayed.
+ * Records keep collecting in RAM in the meantime.
+ */
+void log_erase(){
+    if(log_session || !paused){
+        bg_job_post(BG_JOB_LOG_ERASE, LOG_ERASE_RETRY_MS);
+        return;
+    }
+    uint16_t sector = (log_sealed_pending ? log_sealed.index : log_fill.index) / LOG_PAGES_PER_SECTOR;
+    if(sector != log_erased_sector){
+        uint32_t ints_id = save_and_disable_interrupts();
+        flash_range_erase(LOG_FLASH_OFFSET + sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+        restore_interrupts(ints_id);
+        log_erased_sector = sector;
+    }
+    bg_job_post(BG_JOB_LOG_PROGRAM, 0);
+}
+
+/**
+ * @brief Get a page to export.
+ * @param pos Flash pages from the oldest, followed by the pages still in RAM.
+ * @return Raw page, or NULL if there's nothing at this position.
+ */
+const uint8_t *log_export_page(uint16_t pos){
+    if(pos < LOG_PAGES){
+        const uint8_t *data = (const uint8_t *) (XIP_BASE + LOG_FLASH_OFFSET)
+                              + ((log_fill.index + 1 + pos) % LOG_PAGES) * LOG_PAGE_SIZE;
+        return (data[0] == LOG_PAGE_MAGIC) ? data : NULL;
+    }
+    if(pos == LOG_PAGES && log_sealed_pending) { return log_sealed.page.data; }
+    if(pos == LOG_PAGES + 1 && log_fill_dirty) { return log_fill.page.data; }
+    return NULL;
+}
+
+/**
+ * @brief Start exporting the log over USB.
+ */
+void log_export_start(){
+    log_export_pos = 0;
+    bg_job_post(BG_JOB_LOG_EXPORT, 0);
+}
+
+/**
+ * @brief Background job: print the next log page over USB, hex-encoded.
+ * Decode the output with tools/log_decode.c.
+ */
+void log_export(){
+    const uint8_t *data = NULL;
+    while(!data && log_export_pos < LOG_PAGES + 2){
+        data = log_export_page(log_export_pos++);
+    }
+    if(!data){
+        printf("LOG END\n");
+        return;
+    }
+    printf("LOG ");
+    for(uint16_t i=0; i<LOG_PAGE_SIZE; i++) { printf("%02x", data[i]); }
+    printf("\n");
+    bg_job_post(BG_JOB_LOG_EXPORT, 0);
+}
+/** @} */
+
+#if PHASE_INDICATOR
+/**
+ * @defgroup PhaseIndicator Phase Indicator
+ * @{
+ */
+#define PHASE_PWM_WRAP 255
+
+static const uint8_t led_pins[3] = {RGB_R_PIN, RGB_G_PIN, RGB_B_PIN};
+static uint8_t phase_slices[3];     // PWM slices driving the LEDs
+static uint8_t phase_num_slices;
+static uint32_t phase_dma_mask;
+static uint8_t phase_dma[3];        // One DMA channel per slice
+static uint32_t phase_curve[3][PHASE_STEPS]; // Compare register values, one table per slice
+
+/**
+ * @brief Set up the LED PWM, the fade curves and the DMA channels streaming them.
+ */
+void phase_init(){
+    bool invert[3][2] = {0};
+    for(uint8_t i=0; i<3; i++){
+        uint8_t slice = pwm_gpio_to_slice_num(led_pins[i]);
+        uint8_t channel = pwm_gpio_to_channel(led_pins[i]);
+        uint8_t k = 0;
+        while(k < phase_num_slices && phase_slices[k] != slice) { k++; }
+        if(k == phase_num_slices) { phase_slices[phase_num_slices++] = slice; }
+        // Common anode LEDs: invert the output so that levels are brightness
+        invert[k][channel] = true;
+        gpio_set_function(led_pins[i], GPIO_FUNC_PWM);
+        // Ease in, so the fade speeds up as the beat approaches
+        for(uint16_t s=0; s<PHASE_STEPS; s++){
+            uint32_t level = (uint32_t)PHASE_MAX_LEVEL * s * s / ((PHASE_STEPS - 1) * (PHASE_STEPS - 1));
+            phase_curve[k][s] |= level << (channel == PWM_CHAN_B ? 16 : 0);
+        }
+    }
+
+    for(uint8_t k=0; k<phase_num_slices; k++){
+        pwm_set_wrap(phase_slices[k], PHASE_PWM_WRAP);
+        pwm_set_output_polarity(phase_slices[k], invert[k][PWM_CHAN_A], invert[k][PWM_CHAN_B]);
+        pwm_set_enabled(phase_slices[k], true);
+
+        phase_dma[k] = dma_claim_unused_channel(true);
+        phase_dma_mask |= 1u << phase_dma[k];
+        dma_channel_config c = dma_channel_get_default_config(phase_dma[k]);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, true);
+        channel_config_set_write_increment(&c, false);
+        channel_config_set_dreq(&c, DREQ_PWM_WRAP0 + PHASE_PACER_SLICE);
+        dma_channel_configure(phase_dma[k], &c, &pwm_hw->slice[phase_slices[k]].cc,
+                              phase_curve[k], PHASE_STEPS, false);
+    }
+}
+
+/**
+ * @brief Stop the fade and turn the LEDs off.
+ */
+void phase_stop(){
+    pwm_set_enabled(PHASE_PACER_SLICE, false);
+    for(uint8_t k=0; k<phase_num_slices; k++){
+        dma_channel_abort(phase_dma[k]);
+        pwm_hw->slice[phase_slices[k]].cc = 0;
+    }
+}
+
+/**
+ * @brief Start fading towards the next tick.
+ * The pacer slice wraps once per step, and each wrap moves every DMA channel
+ * one step along its curve, so the CPU is not involved until the next tick.
+ */
+void phase_start(){
+    int64_t remaining_us = (int64_t)(last_tick_time + tick_interval - time_us_64());
+    if(remaining_us < PHASE_STEPS * 100) { return; } // Too close to the next tick to bother
+
+    uint64_t step_cycles = (uint64_t)clock_get_hz(clk_sys) * remaining_us / 1000000 / PHASE_STEPS;
+    if(step_cycles > 255 * 65536) { step_cycles = 255 * 65536; } // Slowest the pacer can go
+    uint32_t div = (step_cycles + 65535) / 65536;
+    uint32_t wrap = step_cycles / div; // At most 65536
+
+    pwm_set_clkdiv_int_frac(PHASE_PACER_SLICE, div, 0);
+    pwm_set_wrap(PHASE_PACER_SLICE, wrap - 1);
+    pwm_set_counter(PHASE_PACER_SLICE, 0);
+    for(uint8_t k=0; k<phase_num_slices; k++){
+        dma_channel_set_read_addr(phase_dma[k], phase_curve[k], false);
+        dma_channel_set_trans_count(phase_dma[k], PHASE_STEPS, false);
+    }
+    dma_start_channel_mask(phase_dma_mask);
+    pwm_set_enabled(PHASE_PACER_SLICE, true);
+}
+/** @} */
+#endif
+
+#if EDGE_CAPTURE
+/**
+ * @defgroup EdgeCapture Edge Capture
+ * @{
+ */
+#define EDGE_MOTOR 3
+
+static const uint8_t edge_pins[EDGE_CHANNELS] = {RGB_R_PIN, RGB_G_PIN, RGB_B_PIN, MOTOR_PIN};
+static const char *edge_names[EDGE_CHANNELS] = {"red", "green", "blue", "motor"};
+static uint32_t edge_ring[EDGE_CHANNELS][EDGE_RING_WORDS] __attribute__((aligned(EDGE_RING_WORDS * 4)));
+static uint16_t edge_ring_tail[EDGE_CHANNELS];
+static uint8_t edge_dma[EDGE_CHANNELS];
+static uint8_t edge_sm[EDGE_CHANNELS];
+static uint8_t edge_channel_mask;   // Channels being captured
+static uint64_t edge_start_time;    // When the state machines started counting
+static edge_matcher_t edge_matcher;
+
+// Expected edges, queued by tick() in interrupt context and matched in the main loop
+#define EDGE_EXPECT_QUEUE 32
+static struct {
+    uint32_t time_us;
+    uint8_t channel;
+    bool level;
+} edge_expect_queue[EDGE_EXPECT_QUEUE];
+static volatile uint8_t edge_expect_head;
+static volatile uint8_t edge_expect_tail;
+static uint32_t edge_expect_dropped;      // Interrupt queue was full
+static uint32_t edge_match_dropped;       // Matcher queue of the channel was full
+
+/**
+ * @brief Start one capture state machine and DMA ring per output pin.
+ */
+void edge_capture_init(){
+    PIO pio = pio0;
+    uint offset = pio_add_program(pio, &edge_capture_program);
+    float div = (float)clock_get_hz(clk_sys) / (edge_capture_CYCLES_PER_SAMPLE * 1000000);
+    uint32_t sm_mask = 0;
+    for(uint8_t ch=0; ch<EDGE_CHANNELS; ch++){
+#if PHASE_INDICATOR
+        if(ch != EDGE_MOTOR) { continue; } // The fade looks like activity
+#endif
+        // The LEDs are common anode, so they're active low
+        if(ch != EDGE_MOTOR) { gpio_set_inover(edge_pins[ch], GPIO_OVERRIDE_INVERT); }
+        edge_sm[ch] = pio_claim_unused_sm(pio, true);
+        edge_capture_program_init(pio, edge_sm[ch], offset, edge_pins[ch], div);
+
+        edge_dma[ch] = dma_claim_unused_channel(true);
+        dma_channel_config c = dma_channel_get_default_config(edge_dma[ch]);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_ring(&c, true, __builtin_ctz(EDGE_RING_WORDS * 4));
+        channel_config_set_dreq(&c, pio_get_dreq(pio, edge_sm[ch], false));
+        dma_channel_configure(edge_dma[ch], &c, edge_ring[ch], &pio->rxf[edge_sm[ch]], 0xFFFFFFFF, true);
+        edge_channel_mask |= 1 << ch;
+        sm_mask |= 1 << edge_sm[ch];
+    }
+    edge_match_init(&edge_matcher);
+    pio_enable_sm_mask_in_sync(pio, sm_mask);
+    edge_start_time = time_us_64();
+    bg_job_post(BG_JOB_EDGE_CHECK, EDGE_CHECK_MS);
+}
+
+/**
+ * @brief Queue an expected edge. Called in interrupt context.
+ */
+void edge_expect(uint8_t channel, uint64_t time_us, bool level){
+    if(!(edge_channel_mask & (1 << channel))) { return; }
+    uint8_t next = (edge_expect_head + 1) % EDGE_EXPECT_QUEUE;
+    if(next == edge_expect_tail) {
+        edge_expect_dropped++;
+        return;
+    }
+    edge_expect_queue[edge_expect_head].time_us = time_us;
+    edge_expect_queue[edge_expect_head].channel = channel;
+    edge_expect_queue[edge_expect_head].level = level;
+    edge_expect_head = next;
+}
+
+/**
+ * @brief Queue the edges a tick is expected to produce.
+ * @param intended When the tick was scheduled.
+ * @param is_first Whether the tick blinks purple rather than white.
+ * @param vibrating Whether the tick vibrates.
+ */
+void edge_expect_tick(uint64_t intended, bool is_first, bool vibrating){
+    // Outputs that run into the next tick never produce their end edges
+    if(tick_interval < OUTPUT_SETTLE_US + EDGE_MATCH_WINDOW_US) { return; }
+    for(uint8_t ch=0; ch<3; ch++){
+        if(ch == 1 && is_first) { continue; } // Purple has no green
+        edge_expect(ch, intended, true);
+        edge_expect(ch, intended + BLINK_DURATION_MS * 1000, false);
+    }
+    if(vibrating){
+        edge_expect(EDGE_MOTOR, intended, true);
+        edge_expect(EDGE_MOTOR, intended + VIBRATION_DURATION_MS * 1000, false);
+    }
+}
+
+/**
+ * @brief Convert a captured sample count to a time.
+ * @param count 31-bit down-counter value pushed by the state machine.
+ * @param now Current time, in us since boot. The sample must be from the last 35 minutes.
+ * @return Time of the sample, in us since boot.
+ */
+uint64_t edge_time(uint32_t count, uint64_t now){
+    uint64_t elapsed_now = now - edge_start_time;
+    uint32_t elapsed = (0x7FFFFFFF - count) & 0x7FFFFFFF;
+    return now - ((elapsed_now - elapsed) & 0x7FFFFFFF);
+}
+
+/**
+ * @brief Background job: match the captured edges against the expected ones.
+ */
+void edge_check(){
+    while(edge_expect_tail != edge_expect_head){
+        uint8_t i = edge_expect_tail;
+        if(!edge_match_expect(&edge_matcher, edge_expect_queue[i].channel,
+                              edge_expect_queue[i].time_us, edge_expect_queue[i].level)){
+            edge_match_dropped++;
+        }
+        edge_expect_tail = (i + 1) % EDGE_EXPECT_QUEUE;
+    }
+
+    uint64_t now = time_us_64();
+    for(uint8_t ch=0; ch<EDGE_CHANNELS; ch++){
+        if(!(edge_channel_mask & (1 << ch))) { continue; }
+        uint16_t head = (dma_hw->ch[edge_dma[ch]].write_addr - (uint32_t)edge_ring[ch]) / 4;
+        while(edge_ring_tail[ch] != head){
+            uint32_t event = edge_ring[ch][edge_ring_tail[ch]];
+            edge_ring_tail[ch] = (edge_ring_tail[ch] + 1) % EDGE_RING_WORDS;
+            bool onset = event & 1;
+            uint64_t t = edge_time(event >> 1, now);
+            if(!onset) { t -= edge_capture_IDLE_SAMPLES - 1; } // Back to the first idle sample
+            edge_match_edge(&edge_matcher, ch, (uint32_t)t, onset);
+        }
+    }
+    // End events come in up to IDLE_SAMPLES late
+    edge_match_expire(&edge_matcher, (uint32_t)(now - edge_capture_IDLE_SAMPLES));
+    bg_job_post(BG_JOB_EDGE_CHECK, EDGE_CHECK_MS);
+}
+
+/**
+ * @brief Print the output timing error histograms.
+ */
+void edge_print_stats(){
+    for(uint8_t ch=0; ch<EDGE_CHANNELS; ch++){
+        if(!(edge_channel_mask & (1 << ch))) { continue; }
+        edge_hist_t *h = &edge_matcher.channels[ch].hist;
+        printf("edges %s: %lu matched, mean %ldus, worst %ldus, %lu missed, %lu unexpected\n",
+               edge_names[ch], (unsigned long)h->matched,
+               (long)(h->matched ? h->error_sum_us / h->matched : 0), (long)h->worst_us,
+               (unsigned long)h->missed, (unsigned long)h->unexpected);
+        printf("  ");
+        for(uint8_t b=0; b<EDGE_HIST_BUCKETS; b++){
+            printf("%s%uus:%lu", (b == EDGE_HIST_BUCKETS - 1) ? ">=" : "<",
+                   (b == EDGE_HIST_BUCKETS - 1) ? 1u << b : 2u << b, (unsigned long)h->buckets[b]);
+            printf(b < EDGE_HIST_BUCKETS - 1 ? " " : "\n");
+        }
+    }
+    if(edge_expect_dropped || edge_match_dropped){
+        printf("edges dropped %lu from the tick queue, %lu from the matcher\n",
+               (unsigned long)edge_expect_dropped, (unsigned long)edge_match_dropped);
+    }
+}
+/** @} */
+#endif
+
 /**
  * @defgroup LEDFunctions LED Functions
  * @{
@@ -182,11 +989,19 @@ uint8_t interval_to_bpm(uint64_t interval){
  * @param b Blue component of the color.
  */
 void rgb(bool r, bool g, bool b){
+#if PHASE_INDICATOR
+    // The PWM outputs are already inverted, see phase_init()
+    phase_stop();
+    pwm_set_gpio_level(RGB_R_PIN, r ? PHASE_PWM_WRAP + 1 : 0);
+    pwm_set_gpio_level(RGB_G_PIN, g ? PHASE_PWM_WRAP + 1 : 0);
+    pwm_set_gpio_level(RGB_B_PIN, b ? PHASE_PWM_WRAP + 1 : 0);
+#else
     // Since we're using common anode RGB LEDs,
     // RGB values have to be inverted 
     gpio_put(RGB_R_PIN, !r);
     gpio_put(RGB_G_PIN, !g);
     gpio_put(RGB_B_PIN, !b);
+#endif
 }
 
 
@@ -216,20 +1031,19 @@ void blink(uint16_t ms, uint8_t color){ // LEDs blink for the specified time in
 
 /**
  * @brief Vibrate the motor for the specified duration.
- * @param ms Duration of the vibration in milliseconds.
+ * The drive is compensated for the battery voltage, so intensity stays the same
+ * as the battery discharges.
+ * @param ms Duration of the vibration in milliseconds. Must be longer than the kick time.
  * @param is_first Whether this is the first subdivision of the beat.
  */
 void vibrate(uint16_t ms, bool is_first){
-    if(is_first){
-        pwm_set_wrap(motor_pin_slice, 1);
-        pwm_set_gpio_level(MOTOR_PIN, 3);
-    } else {
-        pwm_set_wrap(motor_pin_slice, 2);
-        pwm_set_gpio_level(MOTOR_PIN, 1);
-    }
-    pwm_set_enabled(motor_pin_slice, true);
+    const uint16_t (*drive)[MOTOR_DRIVE_STEPS] = is_first ? motor_drive_accent : motor_drive_normal;
+    uint16_t kick_ms = is_first ? MOTOR_KICK_ACCENT_MS : MOTOR_KICK_NORMAL_MS;
     if (vibrate_alarm) cancel_alarm(vibrate_alarm);
-    vibrate_alarm = add_alarm_in_ms(ms, vibrate_complete, NULL, true);
+    motor_sustain_level = motor_drive_level(drive[1], battery_mv);
+    motor_sustain_us = (ms - kick_ms) * 1000;
+    pwm_set_gpio_level(MOTOR_PIN, motor_drive_level(drive[0], battery_mv));
+    vibrate_alarm = add_alarm_in_ms(kick_ms, vibrate_complete, NULL, true);
 }
 /** @} */
 
@@ -252,15 +1066,26 @@ int64_t power_on_complete(){
  * @return 0 on success.
  */
 int64_t blink_complete() {
+    stack_sample_irq();
     rgb(0, 0, 0); // Off
+#if PHASE_INDICATOR
+    if(!paused) { phase_start(); }
+#endif
     return 0;
 }
 
 /**
  * @brief Alarm handler for the vibrate alarm.
- * @return 0 on success.
+ * Fires once at the end of the kick, then again at the end of the vibration.
+ * @return Time until the next stage, or 0 when done.
  */
 int64_t vibrate_complete() {
+    stack_sample_irq();
+    if(motor_sustain_level){
+        pwm_set_gpio_level(MOTOR_PIN, motor_sustain_level);
+        motor_sustain_level = 0;
+        return -(int64_t)motor_sustain_us; // Relative to the end of the kick
+    }
     pwm_set_gpio_level(MOTOR_PIN, 0);
     return 0;
 }
@@ -293,6 +1118,10 @@ int64_t tap_timeout(){
  */
 void stop(){
     cancel_repeating_timer(&metronome);
+#if PHASE_INDICATOR
+    phase_stop();
+#endif
+    if(!paused) { stopped_time = time_us_64(); }
     paused = true;
 }
 
@@ -308,10 +1137,13 @@ void set_tempo(uint8_t t){
     uint64_t interval = bpm_to_interval(t);
     // Apply subdivisions
     interval /= subdiv;
+    tick_interval = interval;
+    next_tick_time = time_us_64() + interval;
     // Use a negative value for more precise ticking
     interval *= -1;
     add_repeating_timer_us(interval, tick, NULL, &metronome);
     paused = false;
+    log_settings();
 }
 
 /**
@@ -319,6 +1151,9 @@ void set_tempo(uint8_t t){
  * @return true on success
  */
 bool tick() {
+    stack_sample_irq();
+    last_tick_time = time_us_64();
+    uint64_t intended = next_tick_time;
     bool is_first = false;
     if(accent && ticks == 0){
         // The first subdivision, the actual beat
@@ -328,54 +1163,89 @@ bool tick() {
         blink(BLINK_DURATION_MS, WHITE);
     }
 
-    if(!gpio_get(VIBR_SWITCH_PIN)) { vibrate(VIBRATION_DURATION_MS, is_first); }
+    bool vibrating = !gpio_get(VIBR_SWITCH_PIN);
+    if(vibrating) { vibrate(VIBRATION_DURATION_MS, is_first); }
+#if EDGE_CAPTURE
+    edge_expect_tick(intended, is_first, vibrating);
+#endif
 
     if(++ticks >= subdiv) { ticks = 0; }
 
     if(recalc_interval){ // Tempo is being increased or decreased using + or - keys
-        stop();
-        if(tempo > 0) { set_tempo(tempo); } // Restart
+        // Only the interval changes, so the beat keeps its phase within the measure.
+        // The negative delay schedules the next tick relative to this one.
+        tick_interval = bpm_to_interval(tempo) / subdiv;
+        metronome.delay_us = -(int64_t)tick_interval;
         recalc_interval = false;
     }
+    next_tick_time = intended + tick_interval;
     return true;
 }
 
 /**
- * @brief Increase the tempo of the metronome.
- * @return true on success
+ * @brief Step the tempo up or down without restarting the metronome.
+ * Steps larger than 1 BPM snap the tempo to a multiple of the step.
+ * @param dir 1 to increase the tempo, -1 to decrease it.
+ * @param step Step in beats per minute.
  */
-bool increase_tempo(){
-    if(tempo > 0) { tempo--; }
+void step_tempo(int8_t dir, uint8_t step){
+    int16_t t = (dir > 0) ? (tempo / step + 1) * step : ((tempo - 1) / step) * step;
+    if(t < 1) { t = 1; }
+    if(t > 255) { t = 255; }
+    tempo = (uint8_t)t;
     recalc_interval = true;
-    return true;
+    log_settings();
+}
+
+/**
+ * @brief Increase the tempo of the metronome.
+ */
+void increase_tempo(){
+    step_tempo(1, 1);
 }
 
 /**
  * @brief Decrease the tempo of the metronome.
- * @return true on success
  */
-bool decrease_tempo(){
-    if(tempo < 256) { tempo++; }
-    recalc_interval = true;
-    return true;
+void decrease_tempo(){
+    step_tempo(-1, 1);
+}
+
+/**
+ * @brief Background job: repeat the tempo step while + or - is held.
+ * Repeat rate and step size grow with the hold time.
+ */
+void tempo_repeat(){
+    uint32_t held_ms = (time_us_64() - tempo_repeat_start) / 1000;
+    uint8_t s = 0;
+    while(s + 1 < TEMPO_REPEAT_STAGE_COUNT && held_ms >= tempo_repeat_stages[s + 1][0]) { s++; }
+    step_tempo(tempo_repeat_dir, tempo_repeat_stages[s][2]);
+    bg_job_post(BG_JOB_TEMPO_REPEAT, tempo_repeat_stages[s][1]);
+}
+
+/**
+ * @brief Start repeating tempo steps while a tempo key is held.
+ * @param dir 1 to increase the tempo, -1 to decrease it.
+ */
+void tempo_repeat_start_hold(int8_t dir){
+    tempo_repeat_dir = dir;
+    tempo_repeat_start = time_us_64();
+    bg_job_post(BG_JOB_TEMPO_REPEAT, 0);
+    long_pressed_release_lock = false; // The release event stops the repeat
 }
 
 /**
  * @brief Increase the tempo of the metronome while holding the + key.
  */
 void increase_tempo_hold(){
-    cancel_repeating_timer(&tempo_change);
-    add_repeating_timer_ms(50, increase_tempo, NULL, &tempo_change);
-    long_pressed_release_lock = false;
+    tempo_repeat_start_hold(1);
 }
 
 /**
  * @brief Decrease the tempo of the metronome while holding the - key.
  */
 void decrease_tempo_hold(){
-    cancel_repeating_timer(&tempo_change);
-    add_repeating_timer_ms(50, decrease_tempo, NULL, &tempo_change);
-    long_pressed_release_lock = false;
+    tempo_repeat_start_hold(-1);
 }
 
 /**
@@ -406,6 +1276,7 @@ void toggle_pause(){
  */
 void toggle_accent(){
     accent = !accent;
+    log_settings();
 }
 
 /**
@@ -427,6 +1298,7 @@ void type_tempo(uint8_t n){
  * @brief Tap the tempo.
  */
 void tap(){
+    tap_in_progress = true;
     stop();
     if(tap_timeout_alarm) { cancel_alarm (tap_timeout_alarm); }
     tap_timeout_alarm = add_alarm_in_ms(INPUT_TIMEOUT_MS, tap_timeout, NULL, true);
@@ -434,11 +1306,22 @@ void tap(){
     static uint64_t last_tap;
     uint64_t now = time_us_64();
 
-    if(++num_taps > 1) {
-        tap_interval_avg = (tap_interval_avg + (now - last_tap)) / 2; // Average past and current tap tempi
+    if(++num_taps == 1) {
+        log_taps(); // A new tap sequence begins
+    } else {
+        uint64_t tap_interval = now - last_tap;
+        if(num_taps > 2) {
+            // Measure how far each tap falls from the running average
+            tap_error_sum += (tap_interval > tap_interval_avg) ? tap_interval - tap_interval_avg
+                                                             : tap_interval_avg - tap_interval;
+            tap_count++;
+            tap_last_ms = now / 1000;
+        }
+        tap_interval_avg = (tap_interval_avg + tap_interval) / 2; // Average past and current tap tempi
         set_tempo(interval_to_bpm(tap_interval_avg));
     }
     last_tap = now;
+    tap_in_progress = false;
 }
 
 /**
@@ -452,7 +1335,7 @@ void save_preset(uint8_t c){
     accent_presets[c] = accent;
     stop();
     blink(NOTIF_DURATION_MS, GREEN);
-    write_flash_presets();
+    write_flash_presets(); // The metronome is stopped, so there is no beat to delay
     sleep_ms(NOTIF_DURATION_MS); // Prevent other events from accessing the LEDs
     set_tempo(tempo); // Restart
 }
@@ -476,10 +1359,10 @@ void key_pressed(uint8_t key){
 
     switch(key){
         case 12: // Asterisk
-            decrease_tempo();
+            increase_tempo();
             break;
         case 14: // Little gate symbol
-            increase_tempo();
+            decrease_tempo();
             break;
     }
 }
@@ -545,7 +1428,7 @@ void key_released(uint8_t key){
 
         case 12:
         case 14:
-            cancel_repeating_timer(&tempo_change);
+            bg_job_cancel(BG_JOB_TEMPO_REPEAT);
             break;
     }
 
@@ -604,10 +1487,10 @@ void key_long_pressed(uint8_t key){
             break;
 
         case 12: // Asterisk
-            decrease_tempo_hold();
+            increase_tempo_hold();
             break;
         case 14: // Little gate symbol
-            increase_tempo_hold();
+            decrease_tempo_hold();
             break;
     }
 }
@@ -618,6 +1501,7 @@ void key_long_pressed(uint8_t key){
  * @return 0 on success.
  */
 int main() {
+    stack_paint();
     stdio_init_all();
     bi_decl_all();
 
@@ -627,6 +1511,9 @@ int main() {
     gpio_set_dir(RGB_G_PIN, GPIO_OUT);
     gpio_init(RGB_B_PIN);
     gpio_set_dir(RGB_B_PIN, GPIO_OUT);
+#if PHASE_INDICATOR
+    phase_init();
+#endif
 
     gpio_init(VIBR_SWITCH_PIN);
     gpio_set_dir(VIBR_SWITCH_PIN, GPIO_IN);
@@ -635,6 +1522,9 @@ int main() {
     gpio_init(MOTOR_PIN);
     gpio_set_function(MOTOR_PIN, GPIO_FUNC_PWM);
     motor_pin_slice = pwm_gpio_to_slice_num(MOTOR_PIN);
+    pwm_set_wrap(motor_pin_slice, MOTOR_PWM_WRAP);
+    pwm_set_gpio_level(MOTOR_PIN, 0);
+    pwm_set_enabled(motor_pin_slice, true);
     
     // Use the onboard LED as a power-on indicator
     gpio_init(PICO_DEFAULT_LED_PIN);
@@ -645,10 +1535,10 @@ int main() {
     gpio_init(LOW_BATT_LED_PIN);
     gpio_set_dir(LOW_BATT_LED_PIN, GPIO_OUT);
 
-    adc_init();
-    battery_check_init(5000, NULL, battery_low_callback);
+    battery_check_init();
 
-    add_repeating_timer_ms(5000, inactive_check, NULL, &inactive_alarm);
+    bg_job_post(BG_JOB_INACTIVE_CHECK, INACTIVE_CHECK_MS);
+    bg_job_post(BG_JOB_BATTERY_CHECK, BATTERY_CHECK_MS);
 
     // Initialize the keypad with column and row configuration
     // And declare the number of columns and rows of the keypad
@@ -661,9 +1551,15 @@ int main() {
 
     // Attempt to load the tempo presets, if they were previously stored on flash
     read_flash_presets();
+    log_init();
+#if EDGE_CAPTURE
+    edge_capture_init();
+#endif
 
     while (true) {
         keypad_read(&keypad);
+        usb_command_poll();
+        bg_run();
         sleep_ms(5);
     }
 
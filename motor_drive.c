@@ -0,0 +1,22 @@
+/**
+ * @file motor_drive.c
+ * @brief Battery-compensated motor drive levels.
+ * @author Turi Scandurra
+ */
+
+#include "config.h"
+#include "motor_drive.h"
+
+/**
+ * @brief Look up a motor drive level for a battery voltage.
+ * @param table One row of a motor drive table.
+ * @param battery_mv Battery voltage in millivolts.
+ * @return Drive level, interpolated between the two closest entries.
+ */
+uint16_t motor_drive_level(const uint16_t *table, uint16_t battery_mv){
+    if(battery_mv <= MOTOR_DRIVE_MIN_MV) { return table[0]; }
+    uint16_t i = (battery_mv - MOTOR_DRIVE_MIN_MV) / MOTOR_DRIVE_STEP_MV;
+    if(i >= MOTOR_DRIVE_STEPS - 1) { return table[MOTOR_DRIVE_STEPS - 1]; }
+    int32_t frac = (battery_mv - MOTOR_DRIVE_MIN_MV) % MOTOR_DRIVE_STEP_MV;
+    return table[i] + ((table[i + 1] - table[i]) * frac) / MOTOR_DRIVE_STEP_MV;
+}
@@ -0,0 +1,16 @@
+/**
+ * @file motor_drive.h
+ * @brief Battery-compensated motor drive levels.
+ *
+ * Looks up the drive tables in config.h (MOTOR_DRIVE_ACCENT, MOTOR_DRIVE_NORMAL)
+ * for a battery voltage, interpolating between the two closest rows.
+ */
+
+#ifndef MOTOR_DRIVE_H_
+#define MOTOR_DRIVE_H_
+
+#include <stdint.h>
+
+uint16_t motor_drive_level(const uint16_t *table, uint16_t battery_mv);
+
+#endif /* MOTOR_DRIVE_H_ */
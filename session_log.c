@@ -0,0 +1,226 @@
+/**
+ * @file session_log.c
+ * @brief Compact encoding of the practice-session log.
+ * @author Turi Scandurra
+ */
+
+#include <string.h>
+#include "session_log.h"
+
+#define LOG_MAX_RECORD_SIZE 16      // Type byte and up to three 5-byte varints
+
+/**
+ * @brief Write a varint.
+ * @param out Output buffer.
+ * @param value Value to encode.
+ * @return Number of bytes written.
+ */
+static uint8_t put_varint(uint8_t *out, uint32_t value){
+    uint8_t n = 0;
+    while(value >= 0x80){
+        out[n++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = value;
+    return n;
+}
+
+/**
+ * @brief Read a varint.
+ * @param reader Log reader, advanced past the varint.
+ * @param value Decoded value.
+ * @return false if the varint runs past the end of the page.
+ */
+static bool get_varint(log_reader_t *reader, uint32_t *value){
+    *value = 0;
+    for(uint8_t shift=0; shift<35; shift+=7){
+        if(reader->pos >= LOG_PAGE_SIZE) { return false; }
+        uint8_t b = reader->data[reader->pos++];
+        *value |= (uint32_t)(b & 0x7F) << shift;
+        if(!(b & 0x80)) { return true; }
+    }
+    return false;
+}
+
+static void put_u32(uint8_t *out, uint32_t value){
+    for(uint8_t i=0; i<4; i++) { out[i] = value >> (8 * i); }
+}
+
+static uint32_t get_u32(const uint8_t *in){
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+/**
+ * @brief Start a new, empty page.
+ * @param page Page to initialize.
+ * @param seq Sequence number, increasing with every page written.
+ * @param boot Boot number, increasing with every power-on.
+ * @param now_ms Time since boot, used as the base for the first record.
+ */
+void log_page_begin(log_page_t *page, uint32_t seq, uint16_t boot, uint32_t now_ms){
+    memset(page->data, LOG_REC_END, LOG_PAGE_SIZE);
+    page->data[0] = LOG_PAGE_MAGIC;
+    put_u32(&page->data[1], seq);
+    page->data[5] = boot & 0xFF;
+    page->data[6] = boot >> 8;
+    put_u32(&page->data[7], now_ms);
+    page->len = LOG_HEADER_SIZE;
+    page->programmed_len = 0;
+    page->last_ms = now_ms;
+    page->last_tempo = 0;
+    page->prev_type = 0;
+}
+
+/**
+ * @brief Append a record to a page.
+ * A tempo or pattern change that closely follows another one of the same type
+ * replaces it, so that holding a key or typing digits doesn't flood the log.
+ * Records that are already on flash are never replaced.
+ * @param page Page to append to.
+ * @param rec Record to encode.
+ * @return false if the record doesn't fit in the page.
+ */
+bool log_page_append(log_page_t *page, const log_record_t *rec){
+    bool coalesce = (rec->type == LOG_REC_TEMPO || rec->type == LOG_REC_PATTERN)
+                    && rec->type == page->prev_type
+                    && page->prev_len >= page->programmed_len
+                    && rec->time_ms - page->last_ms < LOG_COALESCE_MS;
+    uint16_t len = coalesce ? page->prev_len : page->len;
+    uint32_t last_ms = coalesce ? page->prev_ms : page->last_ms;
+    uint8_t last_tempo = coalesce ? page->prev_tempo : page->last_tempo;
+
+    uint8_t buf[LOG_MAX_RECORD_SIZE];
+    uint8_t n = 0;
+    buf[n++] = rec->type;
+    n += put_varint(&buf[n], rec->time_ms - last_ms);
+    switch(rec->type){
+        case LOG_REC_START:
+            n += put_varint(&buf[n], rec->tempo);
+            n += put_varint(&buf[n], rec->subdiv);
+            n += put_varint(&buf[n], rec->accent);
+            break;
+        case LOG_REC_TEMPO: {
+            int32_t delta = (int32_t)rec->tempo - last_tempo;
+            n += put_varint(&buf[n], ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31)); // Zigzag
+            break;
+        }
+        case LOG_REC_PATTERN:
+            n += put_varint(&buf[n], rec->subdiv | (rec->accent << 4));
+            break;
+        case LOG_REC_TAPS:
+            n += put_varint(&buf[n], rec->taps);
+            n += put_varint(&buf[n], rec->tap_error_us);
+            break;
+    }
+    if(len + n > LOG_PAGE_SIZE) { return false; }
+
+    // Coalescing may shorten the page, so clear whatever the old record left behind
+    memset(&page->data[len], LOG_REC_END, page->len - len);
+    memcpy(&page->data[len], buf, n);
+    page->prev_type = rec->type;
+    page->prev_len = len;
+    page->prev_ms = last_ms;
+    page->prev_tempo = last_tempo;
+    page->len = len + n;
+    page->last_ms = rec->time_ms;
+    if(rec->type == LOG_REC_START || rec->type == LOG_REC_TEMPO) {
+        page->last_tempo = rec->tempo;
+    } else {
+        page->last_tempo = last_tempo;
+    }
+    return true;
+}
+
+/**
+ * @brief Mark everything in a page as written to flash.
+ * Flash can only clear bits, so from now on records can only be added after these.
+ * @param page Page that was just programmed.
+ */
+void log_page_programmed(log_page_t *page){
+    page->programmed_len = page->len;
+    page->prev_type = 0;
+}
+
+/**
+ * @brief Parse a page header.
+ * @param data Raw page.
+ * @param seq Sequence number.
+ * @param boot Boot number.
+ * @param base_ms Time base of the page.
+ * @return false if the data is not a log page.
+ */
+bool log_page_header(const uint8_t *data, uint32_t *seq, uint16_t *boot, uint32_t *base_ms){
+    if(data[0] != LOG_PAGE_MAGIC) { return false; }
+    *seq = get_u32(&data[1]);
+    *boot = data[5] | (data[6] << 8);
+    *base_ms = get_u32(&data[7]);
+    return true;
+}
+
+/**
+ * @brief Prepare to read the records of a page.
+ * @param reader Reader to initialize.
+ * @param data Raw page.
+ * @return false if the data is not a log page.
+ */
+bool log_reader_init(log_reader_t *reader, const uint8_t *data){
+    uint32_t seq;
+    uint16_t boot;
+    if(!log_page_header(data, &seq, &boot, &reader->time_ms)) { return false; }
+    reader->data = data;
+    reader->pos = LOG_HEADER_SIZE;
+    reader->tempo = 0;
+    return true;
+}
+
+/**
+ * @brief Read the next record of a page.
+ * @param reader Log reader.
+ * @param rec Decoded record.
+ * @return false at the end of the page, or if the page is corrupted.
+ */
+bool log_reader_next(log_reader_t *reader, log_record_t *rec){
+    if(reader->pos >= LOG_PAGE_SIZE) { return false; }
+    memset(rec, 0, sizeof(*rec));
+    rec->type = reader->data[reader->pos++];
+    if(rec->type == LOG_REC_END) { return false; }
+
+    uint32_t v[3] = {0};
+    uint8_t fields = 0;
+    switch(rec->type){
+        case LOG_REC_START: fields = 3; break;
+        case LOG_REC_TAPS:  fields = 2; break;
+        case LOG_REC_TEMPO:
+        case LOG_REC_PATTERN: fields = 1; break;
+        case LOG_REC_STOP:  fields = 0; break;
+        default: return false;
+    }
+    uint32_t dt;
+    if(!get_varint(reader, &dt)) { return false; }
+    for(uint8_t i=0; i<fields; i++){
+        if(!get_varint(reader, &v[i])) { return false; }
+    }
+
+    reader->time_ms += dt;
+    rec->time_ms = reader->time_ms;
+    switch(rec->type){
+        case LOG_REC_START:
+            reader->tempo = v[0];
+            rec->subdiv = v[1];
+            rec->accent = v[2];
+            break;
+        case LOG_REC_TEMPO:
+            reader->tempo += (int32_t)((v[0] >> 1) ^ -(v[0] & 1)); // Undo zigzag
+            break;
+        case LOG_REC_PATTERN:
+            rec->subdiv = v[0] & 0x0F;
+            rec->accent = v[0] >> 4;
+            break;
+        case LOG_REC_TAPS:
+            rec->taps = v[0];
+            rec->tap_error_us = v[1];
+            break;
+    }
+    rec->tempo = reader->tempo;
+    return true;
+}
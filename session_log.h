@@ -0,0 +1,75 @@
+/**
+ * @file session_log.h
+ * @brief Compact encoding of the practice-session log.
+ *
+ * The log is a sequence of flash pages. Each page starts with a header and holds
+ * variable-length records, padded with 0xFF (erased flash). Every field after the
+ * record type is a LEB128 varint, times are deltas from the previous record and
+ * tempo changes are deltas from the previous tempo. Delta state restarts on each
+ * page, so any page can be decoded on its own.
+ *
+ * Header: magic (1 byte), sequence number (4 bytes), boot number (2 bytes),
+ * time base in ms since boot (4 bytes). Multi-byte header fields are little-endian.
+ */
+
+#ifndef SESSION_LOG_H_
+#define SESSION_LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LOG_PAGE_SIZE       256
+#define LOG_PAGE_MAGIC      0xA5
+#define LOG_HEADER_SIZE     11
+#define LOG_COALESCE_MS     2000    // Tempo or pattern changes closer than this replace each other
+
+/**
+ * @defgroup LogRecords Log Record Types
+ * @{
+ */
+#define LOG_REC_START       1       // Fields: time, tempo, subdiv, accent
+#define LOG_REC_TEMPO       2       // Fields: time, tempo delta (zigzag)
+#define LOG_REC_PATTERN     3       // Fields: time, subdiv | accent << 4
+#define LOG_REC_TAPS        4       // Fields: time, number of taps, mean tap error in us
+#define LOG_REC_STOP        5       // Fields: time
+#define LOG_REC_END         0xFF    // Erased flash, no more records in this page
+/** @} */
+
+typedef struct {
+    uint8_t type;
+    uint32_t time_ms;               // Time since boot
+    uint8_t tempo;
+    uint8_t subdiv;
+    bool accent;
+    uint16_t taps;
+    uint32_t tap_error_us;
+} log_record_t;
+
+typedef struct {
+    uint8_t data[LOG_PAGE_SIZE];
+    uint16_t len;                   // Bytes used, header included
+    uint16_t programmed_len;        // Bytes already on flash, which can no longer change
+    uint32_t last_ms;
+    uint8_t last_tempo;
+    // State before the latest record, so that it can be coalesced
+    uint8_t prev_type;
+    uint16_t prev_len;
+    uint32_t prev_ms;
+    uint8_t prev_tempo;
+} log_page_t;
+
+typedef struct {
+    const uint8_t *data;
+    uint16_t pos;
+    uint32_t time_ms;
+    uint8_t tempo;
+} log_reader_t;
+
+void log_page_begin(log_page_t *page, uint32_t seq, uint16_t boot, uint32_t now_ms);
+bool log_page_append(log_page_t *page, const log_record_t *rec);
+void log_page_programmed(log_page_t *page);
+bool log_page_header(const uint8_t *data, uint32_t *seq, uint16_t *boot, uint32_t *base_ms);
+bool log_reader_init(log_reader_t *reader, const uint8_t *data);
+bool log_reader_next(log_reader_t *reader, log_record_t *rec);
+
+#endif /* SESSION_LOG_H_ */
@@ -0,0 +1,123 @@
+/**
+ * @file settings.c
+ * @brief Versioned, CRC-protected layout of the settings stored on flash.
+ * @author Turi Scandurra
+ */
+
+#include <string.h>
+#include "settings.h"
+
+#define SETTINGS_V0_MAGIC       {0x42, 0x50, 0x4D} // 'BPM', unversioned layout
+#define SETTINGS_V0_MAGIC_SIZE  3
+#define SETTINGS_V1_SIZE        (3 * SETTINGS_PRESETS)
+
+static void put_u16(uint8_t *out, uint16_t value){
+    out[0] = value;
+    out[1] = value >> 8;
+}
+
+static void put_u32(uint8_t *out, uint32_t value){
+    for(uint8_t i=0; i<4; i++) { out[i] = value >> (8 * i); }
+}
+
+static uint16_t get_u16(const uint8_t *in){
+    return in[0] | (in[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *in){
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+/**
+ * @brief Software CRC-32, for hosts without the DMA sniffer.
+ * @param data Data to checksum.
+ * @param len Length of the data.
+ * @return CRC-32 of the data.
+ */
+uint32_t settings_crc32(const uint8_t *data, uint16_t len){
+    uint32_t crc = 0xFFFFFFFF;
+    for(uint16_t i=0; i<len; i++){
+        crc ^= data[i];
+        for(uint8_t b=0; b<8; b++) { crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1)); }
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Check that the settings are within the ranges the firmware accepts.
+ */
+static bool settings_valid(const settings_t *s){
+    for(uint8_t i=0; i<SETTINGS_PRESETS; i++){
+        if(s->tempo[i] < 1) { return false; }
+        if(s->subdiv[i] < 1 || s->subdiv[i] > 10) { return false; }
+        if(s->accent[i] > 1) { return false; }
+    }
+    return true;
+}
+
+/**
+ * @brief Read a version 1 payload, or the version 1 part of a newer one.
+ */
+static bool read_v1(const uint8_t *payload, uint16_t len, settings_t *s){
+    if(len < SETTINGS_V1_SIZE) { return false; }
+    memcpy(s->tempo, &payload[0], SETTINGS_PRESETS);
+    memcpy(s->subdiv, &payload[SETTINGS_PRESETS], SETTINGS_PRESETS);
+    memcpy(s->accent, &payload[2 * SETTINGS_PRESETS], SETTINGS_PRESETS);
+    return true;
+}
+
+/**
+ * @brief Migrate a version 0 blob: a 3-byte magic followed by the version 1 payload.
+ */
+static bool read_v0(const uint8_t *blob, uint16_t size, settings_t *s){
+    const uint8_t magic[SETTINGS_V0_MAGIC_SIZE] = SETTINGS_V0_MAGIC;
+    if(size < SETTINGS_V0_MAGIC_SIZE + SETTINGS_V1_SIZE) { return false; }
+    if(memcmp(blob, magic, SETTINGS_V0_MAGIC_SIZE)) { return false; }
+    return read_v1(&blob[SETTINGS_V0_MAGIC_SIZE], SETTINGS_V1_SIZE, s);
+}
+
+/**
+ * @brief Encode the settings in the current layout.
+ * @param s Settings to encode.
+ * @param out Output buffer, at least SETTINGS_HEADER_SIZE plus the payload size.
+ * @param crc CRC-32 implementation.
+ * @return Size of the encoded blob.
+ */
+uint16_t settings_encode(const settings_t *s, uint8_t *out, settings_crc_t crc){
+    uint8_t *payload = &out[SETTINGS_HEADER_SIZE];
+    memcpy(&payload[0], s->tempo, SETTINGS_PRESETS);
+    memcpy(&payload[SETTINGS_PRESETS], s->subdiv, SETTINGS_PRESETS);
+    memcpy(&payload[2 * SETTINGS_PRESETS], s->accent, SETTINGS_PRESETS);
+
+    put_u32(&out[0], SETTINGS_MAGIC);
+    put_u16(&out[4], SETTINGS_VERSION);
+    put_u16(&out[6], SETTINGS_V1_SIZE);
+    put_u32(&out[8], crc(payload, SETTINGS_V1_SIZE));
+    return SETTINGS_HEADER_SIZE + SETTINGS_V1_SIZE;
+}
+
+/**
+ * @brief Decode settings of any version.
+ * @param blob Stored data.
+ * @param size Size of the stored data.
+ * @param s Decoded settings. Only written if the blob is valid.
+ * @param crc CRC-32 implementation.
+ * @return false if the blob is missing, corrupted or out of range.
+ */
+bool settings_decode(const uint8_t *blob, uint16_t size, settings_t *s, settings_crc_t crc){
+    settings_t decoded;
+    bool ok;
+    if(size >= SETTINGS_HEADER_SIZE && get_u32(&blob[0]) == SETTINGS_MAGIC){
+        uint16_t version = get_u16(&blob[4]);
+        uint16_t len = get_u16(&blob[6]);
+        if(version < 1 || len > size - SETTINGS_HEADER_SIZE) { return false; }
+        if(crc(&blob[SETTINGS_HEADER_SIZE], len) != get_u32(&blob[8])) { return false; }
+        // Every version so far starts with the version 1 payload
+        ok = read_v1(&blob[SETTINGS_HEADER_SIZE], len, &decoded);
+    } else {
+        ok = read_v0(blob, size, &decoded);
+    }
+    if(!ok || !settings_valid(&decoded)) { return false; }
+    *s = decoded;
+    return true;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file settings.h
+ * @brief Versioned, CRC-protected layout of the settings stored on flash.
+ *
+ * Header: magic (4 bytes), schema version (2 bytes), payload length (2 bytes),
+ * CRC-32 of the payload (4 bytes), all little-endian, followed by the payload.
+ * From version 1 on, new fields are only ever appended to the payload, so
+ * firmware can read the fields it knows from a newer blob.
+ * Blobs written before the header existed (version 0) are migrated on load.
+ */
+
+#ifndef SETTINGS_H_
+#define SETTINGS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SETTINGS_MAGIC          0x53525256  // 'VRRS'
+#define SETTINGS_VERSION        1
+#define SETTINGS_HEADER_SIZE    12
+#define SETTINGS_PRESETS        4
+
+typedef struct {
+    uint8_t tempo[SETTINGS_PRESETS];
+    uint8_t subdiv[SETTINGS_PRESETS];
+    uint8_t accent[SETTINGS_PRESETS];
+} settings_t;
+
+// CRC-32 as used by zlib: reflected, initial value and final XOR 0xFFFFFFFF
+typedef uint32_t (*settings_crc_t)(const uint8_t *data, uint16_t len);
+
+uint32_t settings_crc32(const uint8_t *data, uint16_t len);
+uint16_t settings_encode(const settings_t *s, uint8_t *out, settings_crc_t crc);
+bool settings_decode(const uint8_t *blob, uint16_t size, settings_t *s, settings_crc_t crc);
+
+#endif /* SETTINGS_H_ */
@@ -0,0 +1,245 @@
+/**
+ * @file battery_estimator.c
+ * @brief Host-side battery-life estimator.
+ * Plays a preset or a setlist through a simulation of the metronome engine, tracks
+ * how long the CPU, each LED colour, the motor and USB spend in each state, and
+ * integrates a per-state current model until the battery is flat.
+ * Timing, colours, the phase indicator and motor drive levels come from config.h, so firmware changes
+ * can be checked for battery impact before flashing a unit.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -o battery_estimator tools/battery_estimator.c motor_drive.c
+ *     ./battery_estimator A                 # Default preset A
+ *     ./battery_estimator 120/2/1/30 90/1/0/15   # Setlist of tempo/subdiv/accent/minutes
+ * Options: -c <mAh> battery capacity, -u USB connected, -n vibration switch off.
+ * @author Turi Scandurra
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../config.h"
+#include "../motor_drive.h"
+
+/**
+ * @defgroup CurrentModel Current Model
+ * Logic loads are given at 3.3V and go through the Pico's buck converter,
+ * the motor is driven straight from the battery.
+ * @{
+ */
+#define CPU_ACTIVE_MA           24.0
+#define CPU_SLEEP_MA            13.0    // Waiting in sleep_ms(), clocks running
+#define USB_IDLE_MA             1.5     // USB controller enabled, no host
+#define USB_CONNECTED_MA        8.0
+#define LED_RED_MA              20.0    // Per colour channel, all four LEDs together
+#define LED_GREEN_MA            15.0
+#define LED_BLUE_MA             15.0
+#define MOTOR_RESISTANCE_OHM    40.0
+#define BUCK_EFFICIENCY         0.85
+#define LOGIC_VOLTAGE           3.3
+/** @} */
+
+/**
+ * @defgroup EngineModel Engine Model
+ * @{
+ */
+#define TICK_ACTIVE_US          40      // Tick interrupt, blink and vibrate setup
+#define LOOP_ACTIVE_US          60      // Keypad scan and background jobs, every loop
+#define LOOP_PERIOD_US          5000
+#define SIM_STEP_US             1000
+#define SIM_CHUNK_S             60      // Battery voltage is updated once per chunk
+#define DEFAULT_CAPACITY_MAH    1100
+#define MAX_SETLIST             32
+/** @} */
+
+// Open-circuit voltage of a LiPo cell from 0% to 100% charge, in 10% steps
+static const uint16_t discharge_curve_mv[11] = {3200, 3550, 3650, 3700, 3740, 3780, 3820, 3880, 3960, 4060, 4200};
+
+typedef struct {
+    uint8_t tempo;
+    uint8_t subdiv;
+    bool accent;
+    uint32_t minutes;           // 0 plays the item until the battery is flat
+} setlist_item_t;
+
+typedef struct {
+    double cpu_active_us;
+    double led_us[3];           // Red, green, blue
+    double motor_duty_us;       // Time weighted by duty cycle
+    double total_us;
+} residency_t;
+
+typedef struct {
+    uint64_t now_us;
+    uint64_t next_tick_us;
+    uint64_t blink_end_us;
+    uint64_t vibrate_start_us;
+    uint64_t vibrate_end_us;
+    uint8_t ticks;
+    bool rgb[3];
+    bool is_first;
+} engine_t;
+
+const uint16_t motor_drive_accent[2][MOTOR_DRIVE_STEPS] = MOTOR_DRIVE_ACCENT;
+const uint16_t motor_drive_normal[2][MOTOR_DRIVE_STEPS] = MOTOR_DRIVE_NORMAL;
+
+/**
+ * @brief Battery voltage for a state of charge.
+ * @param soc State of charge, 0 to 1.
+ */
+uint16_t battery_voltage(double soc){
+    if(soc <= 0) { return discharge_curve_mv[0]; }
+    if(soc >= 1) { return discharge_curve_mv[10]; }
+    uint8_t i = (uint8_t)(soc * 10);
+    double frac = soc * 10 - i;
+    return discharge_curve_mv[i] + (discharge_curve_mv[i + 1] - discharge_curve_mv[i]) * frac;
+}
+
+/**
+ * @brief Advance the engine by SIM_STEP_US, mirroring tick(), blink() and vibrate().
+ * @param e Engine state.
+ * @param item Current setlist item.
+ * @param vibration Whether the vibration switch is on.
+ * @param battery_mv Battery voltage, for the motor drive level.
+ * @param r Residency accumulator.
+ */
+void engine_step(engine_t *e, const setlist_item_t *item, bool vibration, uint16_t battery_mv, residency_t *r){
+    uint64_t interval = (60ULL * 1000 * 1000) / item->tempo / item->subdiv;
+    if(e->now_us >= e->next_tick_us){
+        e->next_tick_us += interval;
+        r->cpu_active_us += TICK_ACTIVE_US;
+        e->is_first = item->accent && e->ticks == 0;
+        // Purple on accents, white otherwise
+        e->rgb[0] = true;
+        e->rgb[1] = !e->is_first;
+        e->rgb[2] = true;
+        e->blink_end_us = e->now_us + BLINK_DURATION_MS * 1000;
+        if(vibration){
+            e->vibrate_start_us = e->now_us;
+            e->vibrate_end_us = e->now_us + VIBRATION_DURATION_MS * 1000;
+        }
+        if(++e->ticks >= item->subdiv) { e->ticks = 0; }
+    }
+    if(e->now_us % LOOP_PERIOD_US == 0) { r->cpu_active_us += LOOP_ACTIVE_US; }
+
+    if(e->now_us < e->blink_end_us){
+        for(uint8_t c=0; c<3; c++){
+            if(e->rgb[c]) { r->led_us[c] += SIM_STEP_US; }
+        }
+    }
+#if PHASE_INDICATOR
+    else if(e->next_tick_us > e->blink_end_us){
+        // All channels fade in along the same curve as phase_init() in main.c
+        double x = (double)(e->now_us - e->blink_end_us) / (e->next_tick_us - e->blink_end_us);
+        double brightness = PHASE_MAX_LEVEL * x * x / 256.0;
+        for(uint8_t c=0; c<3; c++) { r->led_us[c] += brightness * SIM_STEP_US; }
+    }
+#endif
+    if(e->now_us < e->vibrate_end_us){
+        const uint16_t (*drive)[MOTOR_DRIVE_STEPS] = e->is_first ? motor_drive_accent : motor_drive_normal;
+        uint16_t kick_ms = e->is_first ? MOTOR_KICK_ACCENT_MS : MOTOR_KICK_NORMAL_MS;
+        bool kick = e->now_us < e->vibrate_start_us + kick_ms * 1000;
+        uint16_t level = motor_drive_level(drive[kick ? 0 : 1], battery_mv);
+        double duty = level > MOTOR_PWM_WRAP ? 1.0 : level / (double)(MOTOR_PWM_WRAP + 1);
+        r->motor_duty_us += duty * SIM_STEP_US;
+    }
+    e->now_us += SIM_STEP_US;
+    r->total_us += SIM_STEP_US;
+}
+
+/**
+ * @brief Average battery current for a residency.
+ * @param r Residency over the period.
+ * @param battery_mv Battery voltage.
+ * @param usb Whether USB is connected.
+ * @return Current in mA.
+ */
+double average_current(const residency_t *r, uint16_t battery_mv, bool usb){
+    double battery_v = battery_mv / 1000.0;
+    double active = r->cpu_active_us / r->total_us;
+    double logic_ma = CPU_ACTIVE_MA * active + CPU_SLEEP_MA * (1 - active)
+                    + (usb ? USB_CONNECTED_MA : USB_IDLE_MA)
+                    + LED_RED_MA * r->led_us[0] / r->total_us
+                    + LED_GREEN_MA * r->led_us[1] / r->total_us
+                    + LED_BLUE_MA * r->led_us[2] / r->total_us;
+    double motor_ma = 1000.0 * battery_v / MOTOR_RESISTANCE_OHM * r->motor_duty_us / r->total_us;
+    return logic_ma * LOGIC_VOLTAGE / (battery_v * BUCK_EFFICIENCY) + motor_ma;
+}
+
+/**
+ * @brief Parse a setlist item, either a preset letter or tempo/subdiv/accent[/minutes].
+ * @return false if the argument is malformed.
+ */
+bool parse_item(const char *arg, setlist_item_t *item){
+    static const uint8_t tempo_presets[4] = DEFAULT_TEMPO_PRESETS;
+    static const uint8_t subdiv_presets[4] = DEFAULT_SUBDIV_PRESETS;
+    static const uint8_t accent_presets[4] = DEFAULT_ACCENT_PRESETS;
+    if(strlen(arg) == 1 && arg[0] >= 'A' && arg[0] <= 'D'){
+        uint8_t c = arg[0] - 'A';
+        *item = (setlist_item_t){ tempo_presets[c], subdiv_presets[c], accent_presets[c], 0 };
+        return true;
+    }
+    unsigned int tempo, subdiv = 1, accent = 0, minutes = 0;
+    if(sscanf(arg, "%u/%u/%u/%u", &tempo, &subdiv, &accent, &minutes) < 1) { return false; }
+    if(tempo < 1 || tempo > 255 || subdiv < 1 || subdiv > 9) { return false; }
+    *item = (setlist_item_t){ tempo, subdiv, accent != 0, minutes };
+    return true;
+}
+
+int main(int argc, char **argv){
+    setlist_item_t setlist[MAX_SETLIST];
+    uint8_t num_items = 0;
+    double capacity_mah = DEFAULT_CAPACITY_MAH;
+    bool usb = false, vibration = true;
+
+    for(int i=1; i<argc; i++){
+        if(!strcmp(argv[i], "-c") && i + 1 < argc) { capacity_mah = atof(argv[++i]); }
+        else if(!strcmp(argv[i], "-u")) { usb = true; }
+        else if(!strcmp(argv[i], "-n")) { vibration = false; }
+        else if(num_items < MAX_SETLIST && parse_item(argv[i], &setlist[num_items])) { num_items++; }
+        else {
+            fprintf(stderr, "Usage: %s [-c mAh] [-u] [-n] A|B|C|D|tempo/subdiv/accent[/minutes]...\n", argv[0]);
+            return 1;
+        }
+    }
+    if(!num_items) { parse_item("A", &setlist[num_items++]); }
+
+    engine_t engine = {0};
+    residency_t total = {0};
+    double used_mah = 0;
+    uint8_t item = 0;
+    uint64_t item_end_us = setlist[0].minutes * 60ULL * 1000 * 1000;
+
+    // Play the setlist on repeat, one chunk at a time, until the battery is flat
+    while(used_mah < capacity_mah){
+        uint16_t battery_mv = battery_voltage(1 - used_mah / capacity_mah);
+        residency_t chunk = {0};
+        for(uint32_t s=0; s<SIM_CHUNK_S * 1000000 / SIM_STEP_US; s++){
+            if(setlist[item].minutes && engine.now_us >= item_end_us){
+                item = (item + 1) % num_items;
+                item_end_us = engine.now_us + setlist[item].minutes * 60ULL * 1000 * 1000;
+                engine.ticks = 0;
+                engine.next_tick_us = engine.now_us;
+            }
+            engine_step(&engine, &setlist[item], vibration, battery_mv, &chunk);
+        }
+        used_mah += average_current(&chunk, battery_mv, usb) * SIM_CHUNK_S / 3600.0;
+        total.cpu_active_us += chunk.cpu_active_us;
+        total.motor_duty_us += chunk.motor_duty_us;
+        total.total_us += chunk.total_us;
+        for(uint8_t c=0; c<3; c++) { total.led_us[c] += chunk.led_us[c]; }
+    }
+
+    double hours = total.total_us / 3600e6;
+    printf("State residency\n");
+    printf("  CPU active   %5.2f%%\n", 100 * total.cpu_active_us / total.total_us);
+    printf("  LED red      %5.2f%%\n", 100 * total.led_us[0] / total.total_us);
+    printf("  LED green    %5.2f%%\n", 100 * total.led_us[1] / total.total_us);
+    printf("  LED blue     %5.2f%%\n", 100 * total.led_us[2] / total.total_us);
+    printf("  Motor duty   %5.2f%%\n", 100 * total.motor_duty_us / total.total_us);
+    printf("Average current %.1f mA\n", capacity_mah / hours);
+    printf("Predicted runtime on %.0f mAh: %.1f hours\n", capacity_mah, hours);
+    return 0;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file check.h
+ * @brief Minimal self-checking helpers for the host-side tests.
+ * Each check prints one line; check_result() gives the exit status.
+ * @author Turi Scandurra
+ */
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+
+static bool check_ok = true;
+
+/**
+ * @brief Report one check.
+ * @param name What is being checked.
+ * @param pass Whether the check passed.
+ */
+static void check(const char *name, bool pass){
+    printf("  %-44s %s\n", name, pass ? "ok" : "FAIL");
+    if(!pass) { check_ok = false; }
+}
+
+/**
+ * @brief Print the overall result.
+ * @return Exit status: 0 if every check passed.
+ */
+static int check_result(){
+    printf("%s\n", check_ok ? "OK" : "FAIL");
+    return check_ok ? 0 : 1;
+}
+
+#endif /* CHECK_H_ */
@@ -0,0 +1,125 @@
+/**
+ * @file edge_match_test.c
+ * @brief Host-side check of the output edge matcher in edge_match.c.
+ * Feeds synthetic streams of expected and captured edges through the matcher
+ * and checks the resulting histograms and counters.
+ * Exits with a non-zero status if any check fails.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -I. -o edge_match_test tools/edge_match_test.c edge_match.c && ./edge_match_test
+ * @author Turi Scandurra
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "edge_match.h"
+#include "check.h"
+
+/**
+ * @brief Edges on time, and a start and end pair.
+ */
+static void test_matched(){
+    edge_matcher_t m;
+    edge_match_init(&m);
+    edge_match_expect(&m, 0, 1000, true);
+    edge_match_expect(&m, 0, 101000, false);
+    edge_match_edge(&m, 0, 1000, true);
+    edge_match_edge(&m, 0, 101001, false);
+    edge_hist_t *h = &m.channels[0].hist;
+    printf("matched\n");
+    check("both edges matched", h->matched == 2);
+    check("errors in the lowest bucket", h->buckets[0] == 2);
+    check("worst error 1us", h->worst_us == 1);
+    check("nothing missed or unexpected", h->missed == 0 && h->unexpected == 0);
+}
+
+/**
+ * @brief Edges late and early, within the window.
+ */
+static void test_late(){
+    edge_matcher_t m;
+    edge_match_init(&m);
+    edge_match_expect(&m, 3, 10000, true);
+    edge_match_expect(&m, 3, 20000, true);
+    edge_match_edge(&m, 3, 10300, true);    // 300us late: bucket 8 (256-511us)
+    edge_match_edge(&m, 3, 19950, true);    // 50us early: bucket 5 (32-63us)
+    edge_hist_t *h = &m.channels[3].hist;
+    printf("late and early\n");
+    check("both edges matched", h->matched == 2);
+    check("300us late in the 256us bucket", h->buckets[8] == 1);
+    check("50us early in the 32us bucket", h->buckets[5] == 1);
+    check("worst error +300us", h->worst_us == 300);
+    check("mean error +125us", h->error_sum_us / h->matched == 125);
+}
+
+/**
+ * @brief Expectations without edges, and edges outside the window.
+ */
+static void test_missed(){
+    edge_matcher_t m;
+    edge_match_init(&m);
+    edge_match_expect(&m, 1, 1000, true);
+    edge_match_expect(&m, 1, 2000, false);
+    edge_match_expect(&m, 1, 50000, true);
+    // An edge long after the first two skips past them
+    edge_match_edge(&m, 1, 50000 + EDGE_MATCH_WINDOW_US, true);
+    edge_match_expect(&m, 1, 100000, false);
+    edge_match_expire(&m, 100000 + EDGE_MATCH_WINDOW_US);
+    edge_hist_t *h = &m.channels[1].hist;
+    printf("missed\n");
+    check("edge at the edge of the window matched", h->matched == 1);
+    check("two skipped expectations missed", h->missed == 2);
+    edge_match_expire(&m, 100000 + EDGE_MATCH_WINDOW_US + 1);
+    check("expired expectation missed", h->missed == 3 && m.channels[1].count == 0);
+}
+
+/**
+ * @brief Edges without expectations, of the wrong level, or far too early.
+ */
+static void test_unexpected(){
+    edge_matcher_t m;
+    edge_match_init(&m);
+    edge_match_edge(&m, 2, 500, true);
+    edge_match_expect(&m, 2, 20000, true);
+    edge_match_edge(&m, 2, 20000, false);   // Wrong level
+    edge_match_edge(&m, 2, 20000 - EDGE_MATCH_WINDOW_US - 1, true); // Too early
+    edge_hist_t *h = &m.channels[2].hist;
+    printf("unexpected\n");
+    check("three unexpected edges", h->unexpected == 3);
+    check("expectation still queued", m.channels[2].count == 1 && h->matched == 0);
+    check("other channels untouched", m.channels[0].hist.unexpected == 0);
+}
+
+/**
+ * @brief Times across the 32-bit wrap, and a full queue.
+ */
+static void test_wrap(){
+    edge_matcher_t m;
+    edge_match_init(&m);
+    edge_match_expect(&m, 0, 0xFFFFFF00, true);
+    edge_match_expect(&m, 0, 0x00000100, false);
+    edge_match_edge(&m, 0, 0x00000010, true);   // 272us late, across the wrap
+    edge_match_edge(&m, 0, 0x000000F0, false);  // 16us early
+    edge_hist_t *h = &m.channels[0].hist;
+    printf("32-bit wrap\n");
+    check("both edges matched", h->matched == 2 && h->missed == 0 && h->unexpected == 0);
+    check("worst error +272us", h->worst_us == 272);
+    edge_match_expect(&m, 0, 0xFFFFF000, true);
+    edge_match_expire(&m, 0x00001000);
+    check("expectation expired across the wrap", h->missed == 1);
+
+    uint8_t queued = 0;
+    while(edge_match_expect(&m, 0, 0x1000 + queued, true)) { queued++; }
+    check("queue holds EDGE_QUEUE_LEN expectations", queued == EDGE_QUEUE_LEN);
+}
+
+int main(){
+    test_matched();
+    test_late();
+    test_missed();
+    test_unexpected();
+    test_wrap();
+
+    return check_result();
+}
@@ -0,0 +1,149 @@
+/**
+ * @file log_decode.c
+ * @brief Host-side decoder for the practice-session log.
+ * Reads the output of the 'l' USB command from stdin and prints the sessions it contains.
+ * A session without a stop record, usually because the device was switched off while
+ * playing, is closed at its last record.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -I. -o log_decode tools/log_decode.c session_log.c
+ *     ./log_decode < log.txt
+ * @author Turi Scandurra
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "session_log.h"
+
+typedef struct {
+    uint8_t data[LOG_PAGE_SIZE];
+    uint32_t seq;
+    uint32_t order;             // Position in the export, later copies win
+} page_t;
+
+/**
+ * @brief Sort pages by sequence number, then by position in the export.
+ */
+static int compare_pages(const void *a, const void *b){
+    const page_t *pa = a, *pb = b;
+    if(pa->seq != pb->seq) { return pa->seq < pb->seq ? -1 : 1; }
+    return pa->order < pb->order ? -1 : (pa->order > pb->order);
+}
+
+/**
+ * @brief Parse one exported page.
+ * @param hex Hex-encoded page.
+ * @param out Raw page.
+ * @return false if the line is malformed.
+ */
+static bool parse_hex(const char *hex, uint8_t *out){
+    for(uint16_t i=0; i<LOG_PAGE_SIZE; i++){
+        unsigned int byte;
+        if(sscanf(&hex[i * 2], "%2x", &byte) != 1) { return false; }
+        out[i] = byte;
+    }
+    return true;
+}
+
+static void print_time(uint32_t ms){
+    printf("%3u:%02u:%02u", ms / 3600000, (ms / 60000) % 60, (ms / 1000) % 60);
+}
+
+/**
+ * @brief Close a session that has no stop record, at its last record.
+ * @param open Whether a session is open. Cleared.
+ * @param start_ms Start of the session.
+ * @param last_ms Time of the session's last record.
+ * @param total_ms Total practice time, updated.
+ */
+static void close_open_session(bool *open, uint32_t start_ms, uint32_t last_ms, uint32_t *total_ms){
+    if(!*open) { return; }
+    *total_ms += last_ms - start_ms;
+    print_time(last_ms);
+    printf("  no stop  after ");
+    print_time(last_ms - start_ms);
+    printf(", at the last record\n");
+    *open = false;
+}
+
+int main(){
+    static char line[LOG_PAGE_SIZE * 2 + 64];
+    page_t *pages = NULL;
+    uint32_t num_pages = 0, capacity = 0;
+
+    while(fgets(line, sizeof(line), stdin)){
+        if(strncmp(line, "LOG ", 4) != 0 || strlen(line) < 4 + LOG_PAGE_SIZE * 2) { continue; }
+        if(num_pages == capacity){
+            capacity = capacity ? capacity * 2 : 256;
+            pages = realloc(pages, capacity * sizeof(page_t));
+            if(!pages) { return 1; }
+        }
+        page_t *page = &pages[num_pages];
+        uint16_t boot;
+        uint32_t base_ms;
+        if(!parse_hex(&line[4], page->data)) { continue; }
+        if(!log_page_header(page->data, &page->seq, &boot, &base_ms)) { continue; }
+        page->order = num_pages++;
+    }
+    qsort(pages, num_pages, sizeof(page_t), compare_pages);
+
+    uint32_t sessions = 0, total_ms = 0;
+    uint32_t start_ms = 0, last_ms = 0;
+    bool open = false;
+    int32_t current_boot = -1;
+    for(uint32_t i=0; i<num_pages; i++){
+        // Pages still in RAM at export time may also have an older copy on flash
+        if(i + 1 < num_pages && pages[i + 1].seq == pages[i].seq) { continue; }
+
+        uint32_t seq, base_ms;
+        uint16_t boot;
+        log_page_header(pages[i].data, &seq, &boot, &base_ms);
+        if(boot != current_boot){
+            close_open_session(&open, start_ms, last_ms, &total_ms);
+            printf("Boot %u\n", boot);
+            current_boot = boot;
+        }
+
+        log_reader_t reader;
+        log_record_t rec;
+        log_reader_init(&reader, pages[i].data);
+        while(log_reader_next(&reader, &rec)){
+            if(rec.type == LOG_REC_START) { close_open_session(&open, start_ms, last_ms, &total_ms); }
+            print_time(rec.time_ms);
+            switch(rec.type){
+                case LOG_REC_START:
+                    start_ms = rec.time_ms;
+                    open = true;
+                    sessions++;
+                    printf("  start    %3u BPM, %u subdiv, accent %s\n", rec.tempo, rec.subdiv, rec.accent ? "on" : "off");
+                    break;
+                case LOG_REC_TEMPO:
+                    printf("  tempo    %3u BPM\n", rec.tempo);
+                    break;
+                case LOG_REC_PATTERN:
+                    printf("  pattern  %u subdiv, accent %s\n", rec.subdiv, rec.accent ? "on" : "off");
+                    break;
+                case LOG_REC_TAPS:
+                    printf("  taps     %u taps, %.1f ms mean error\n", rec.taps, rec.tap_error_us / 1000.0);
+                    break;
+                case LOG_REC_STOP:
+                    if(!open) { printf("  stop\n"); break; }
+                    open = false;
+                    total_ms += rec.time_ms - start_ms;
+                    printf("  stop     after ");
+                    print_time(rec.time_ms - start_ms);
+                    printf("\n");
+                    break;
+            }
+            last_ms = rec.time_ms;
+        }
+    }
+    close_open_session(&open, start_ms, last_ms, &total_ms);
+
+    printf("%u pages, %u sessions, ", num_pages, sessions);
+    print_time(total_ms);
+    printf(" of practice\n");
+    free(pages);
+    return 0;
+}
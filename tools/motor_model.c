@@ -0,0 +1,93 @@
+/**
+ * @file motor_model.c
+ * @brief Host-side check of the battery-compensated motor drive tables in config.h.
+ * Runs a first-order model of the vibration motor through a full pulse for each
+ * battery voltage in the tables, and reports onset time and sustained speed.
+ * Exits with a non-zero status if the compensation drifts out of tolerance.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -o motor_model tools/motor_model.c && ./motor_model
+ * @author Turi Scandurra
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../config.h"
+
+#define MOTOR_TAU_MS        25.0    // Spin-up time constant of the motor
+#define SIM_STEP_MS         0.01
+#define ONSET_THRESHOLD     0.9     // Onset is when the motor reaches this fraction of its target speed
+#define SPEED_TOLERANCE     0.03    // Allowed spread of the sustained speed
+#define ONSET_TOLERANCE_MS  2.0     // Allowed spread of the onset time
+
+typedef struct {
+    const char *name;
+    uint16_t drive[2][MOTOR_DRIVE_STEPS];
+    uint16_t kick_ms;
+    double target_v;                // Effective motor voltage the table aims for
+} drive_table_t;
+
+/**
+ * @brief Simulate one vibration pulse.
+ * Motor speed is expressed as the equivalent steady-state voltage.
+ * @param kick Kick drive level, in tenths of a percent.
+ * @param kick_ms Kick time.
+ * @param sustain Sustain drive level, in tenths of a percent.
+ * @param battery_v Battery voltage.
+ * @param target_v Target effective voltage.
+ * @param onset_ms Output: time to reach ONSET_THRESHOLD of the target, or -1 if never.
+ * @return Speed at the end of the pulse.
+ */
+double simulate_pulse(uint16_t kick, uint16_t kick_ms, uint16_t sustain, double battery_v, double target_v, double *onset_ms){
+    double speed = 0;
+    *onset_ms = -1;
+    for(double t = 0; t < VIBRATION_DURATION_MS; t += SIM_STEP_MS){
+        uint16_t level = (t < kick_ms) ? kick : sustain;
+        double applied_v = battery_v * (level > MOTOR_PWM_WRAP ? 1.0 : level / (double)(MOTOR_PWM_WRAP + 1));
+        speed += (applied_v - speed) * SIM_STEP_MS / MOTOR_TAU_MS;
+        if(*onset_ms < 0 && speed >= target_v * ONSET_THRESHOLD){ *onset_ms = t; }
+    }
+    return speed;
+}
+
+int main(){
+    drive_table_t tables[] = {
+        { "accent", MOTOR_DRIVE_ACCENT, MOTOR_KICK_ACCENT_MS, 3.0 },
+        { "normal", MOTOR_DRIVE_NORMAL, MOTOR_KICK_NORMAL_MS, 1.2 },
+    };
+    bool ok = true;
+
+    for(uint8_t n=0; n<2; n++){
+        drive_table_t *table = &tables[n];
+        double min_speed = 1e9, max_speed = 0, min_onset = 1e9, max_onset = 0;
+        printf("%s drive, target %.2fV\n", table->name, table->target_v);
+        printf("  battery   kick  sustain  onset  speed\n");
+        for(uint8_t i=0; i<MOTOR_DRIVE_STEPS; i++){
+            double battery_v = (MOTOR_DRIVE_MIN_MV + i * MOTOR_DRIVE_STEP_MV) / 1000.0;
+            double onset;
+            double speed = simulate_pulse(table->drive[0][i], table->kick_ms, table->drive[1][i], battery_v, table->target_v, &onset);
+            printf("  %.2fV  %5u  %7u  %4.1fms  %.2fV\n", battery_v, table->drive[0][i], table->drive[1][i], onset, speed);
+            if(onset < 0){
+                printf("  never reaches its target speed\n");
+                ok = false;
+                continue;
+            }
+            if(speed < min_speed) { min_speed = speed; }
+            if(speed > max_speed) { max_speed = speed; }
+            if(onset < min_onset) { min_onset = onset; }
+            if(onset > max_onset) { max_onset = onset; }
+        }
+        if((max_speed - min_speed) > table->target_v * SPEED_TOLERANCE){
+            printf("  sustained speed varies by %.2fV\n", max_speed - min_speed);
+            ok = false;
+        }
+        if((max_onset - min_onset) > ONSET_TOLERANCE_MS){
+            printf("  onset varies by %.1fms\n", max_onset - min_onset);
+            ok = false;
+        }
+    }
+
+    printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+/**
+ * @file settings_test.c
+ * @brief Host-side round-trip check of the stored settings layout in settings.c.
+ * Encodes and decodes settings blobs, including blobs from older and newer
+ * firmware and damaged ones, and checks the software CRC-32 that the DMA
+ * sniffer in main.c has to match.
+ * Exits with a non-zero status if any check fails.
+ *
+ * Build and run from the repository root:
+ *     cc -O2 -I. -o settings_test tools/settings_test.c settings.c && ./settings_test
+ * @author Turi Scandurra
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "settings.h"
+#include "check.h"
+
+#define BLOB_SIZE 256               // One flash page
+
+static const settings_t reference = {
+    .tempo  = {60, 90, 255, 1},
+    .subdiv = {1, 2, 10, 3},
+    .accent = {0, 1, 1, 0},
+};
+
+/**
+ * @brief Encode the reference settings into an erased page.
+ * @param blob Output page.
+ * @return Size of the encoded blob.
+ */
+static uint16_t encode_reference(uint8_t *blob){
+    memset(blob, 0xFF, BLOB_SIZE);
+    return settings_encode(&reference, blob, settings_crc32);
+}
+
+/**
+ * @brief Rewrite the length and CRC of an encoded blob, as newer firmware would.
+ */
+static void reseal(uint8_t *blob, uint16_t version, uint16_t len){
+    uint32_t crc = settings_crc32(&blob[SETTINGS_HEADER_SIZE], len);
+    blob[4] = version;
+    blob[5] = version >> 8;
+    blob[6] = len;
+    blob[7] = len >> 8;
+    for(uint8_t i=0; i<4; i++) { blob[8 + i] = crc >> (8 * i); }
+}
+
+/**
+ * @brief Check that a blob decodes to the reference settings.
+ */
+static bool decodes_to_reference(const uint8_t *blob, uint16_t size){
+    settings_t s;
+    memset(&s, 0, sizeof(s));
+    return settings_decode(blob, size, &s, settings_crc32) && !memcmp(&s, &reference, sizeof(s));
+}
+
+/**
+ * @brief The check value of the zlib CRC-32.
+ */
+static void test_crc(){
+    printf("crc\n");
+    check("CRC-32 of \"123456789\" is 0xCBF43926",
+          settings_crc32((const uint8_t *)"123456789", 9) == 0xCBF43926);
+}
+
+/**
+ * @brief Encode, then decode.
+ */
+static void test_round_trip(){
+    uint8_t blob[BLOB_SIZE];
+    uint16_t size = encode_reference(blob);
+    printf("round trip\n");
+    check("encoded size is header plus 12 bytes", size == SETTINGS_HEADER_SIZE + 3 * SETTINGS_PRESETS);
+    check("decodes from a full page", decodes_to_reference(blob, BLOB_SIZE));
+    check("decodes from the exact size", decodes_to_reference(blob, size));
+    check("fails when the blob is cut short", !decodes_to_reference(blob, size - 1));
+}
+
+/**
+ * @brief Blobs written before the settings header existed.
+ */
+static void test_v0(){
+    uint8_t blob[BLOB_SIZE];
+    memset(blob, 0xFF, BLOB_SIZE);
+    memcpy(blob, "BPM", 3);
+    memcpy(&blob[3], reference.tempo, SETTINGS_PRESETS);
+    memcpy(&blob[3 + SETTINGS_PRESETS], reference.subdiv, SETTINGS_PRESETS);
+    memcpy(&blob[3 + 2 * SETTINGS_PRESETS], reference.accent, SETTINGS_PRESETS);
+    printf("version 0 migration\n");
+    check("'BPM' blob decodes", decodes_to_reference(blob, BLOB_SIZE));
+    blob[3 + SETTINGS_PRESETS] = 11;
+    check("out of range subdivision rejected", !decodes_to_reference(blob, BLOB_SIZE));
+    memset(blob, 0xFF, BLOB_SIZE);
+    check("erased flash rejected", !decodes_to_reference(blob, BLOB_SIZE));
+}
+
+/**
+ * @brief Damaged payloads and lengths.
+ */
+static void test_corruption(){
+    uint8_t blob[BLOB_SIZE];
+    uint16_t size = encode_reference(blob);
+    printf("corruption\n");
+    bool all_caught = true;
+    for(uint16_t bit=SETTINGS_HEADER_SIZE * 8; bit<size * 8; bit++){
+        blob[bit / 8] ^= 1 << (bit % 8);
+        if(decodes_to_reference(blob, BLOB_SIZE)) { all_caught = false; }
+        blob[bit / 8] ^= 1 << (bit % 8);
+    }
+    check("every flipped payload bit rejected", all_caught);
+
+    reseal(blob, SETTINGS_VERSION, 3 * SETTINGS_PRESETS - 1);
+    check("truncated length rejected", !decodes_to_reference(blob, BLOB_SIZE));
+    encode_reference(blob);
+    blob[6] = (BLOB_SIZE - SETTINGS_HEADER_SIZE + 1) & 0xFF;
+    blob[7] = (BLOB_SIZE - SETTINGS_HEADER_SIZE + 1) >> 8;
+    check("length past the end of the page rejected", !decodes_to_reference(blob, BLOB_SIZE));
+    encode_reference(blob);
+    reseal(blob, 0, 3 * SETTINGS_PRESETS);
+    check("version 0 with a header rejected", !decodes_to_reference(blob, BLOB_SIZE));
+}
+
+/**
+ * @brief Blobs from firmware with more settings.
+ */
+static void test_newer(){
+    uint8_t blob[BLOB_SIZE];
+    uint16_t size = encode_reference(blob);
+    // A later version appends fields to the payload
+    const uint8_t extra[] = {0x12, 0x34, 0x56, 0x78, 0x9A};
+    memcpy(&blob[size], extra, sizeof(extra));
+    reseal(blob, SETTINGS_VERSION + 1, 3 * SETTINGS_PRESETS + sizeof(extra));
+    printf("newer version\n");
+    check("known fields read from a newer blob", decodes_to_reference(blob, BLOB_SIZE));
+    blob[size + 2] ^= 0x01;
+    check("damage in the appended fields rejected", !decodes_to_reference(blob, BLOB_SIZE));
+}
+
+int main(){
+    test_crc();
+    test_round_trip();
+    test_v0();
+    test_corruption();
+    test_newer();
+
+    return check_result();
+}